@@ -0,0 +1,266 @@
+/*!
+ * \file
+ * \brief
+ * \details Stable sort which finds presorted runs and merges them, close to linear on nearly sorted input
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef ADAPTIVE_SORT_H_INCLUDED
+#define ADAPTIVE_SORT_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+const size_t ADAPTIVE_MIN_RUN        = 24;  //!< Shorter natural runs are extended by insertion sort
+const size_t ADAPTIVE_MIN_GALLOP     = 7;   //!< Wins in a row after which merge copies whole blocks
+const size_t ADAPTIVE_SAMPLE_WINDOWS = 32;  //!< Number of places looked at by looksPresorted
+const size_t ADAPTIVE_SAMPLE_WINDOW  = 16;  //!< Neighbour elements looked at in every place
+const size_t ADAPTIVE_MIN_SIZE       = 256; //!< Smaller ranges are never worth run detection
+
+/*!
+ * First element of sorted range for which pred is false, found by exponential search from the beginning
+ */
+template <typename Iterator, typename Predicate>
+Iterator gallopSearch(Iterator first, Iterator last, Predicate pred)
+{
+    size_t size = last - first;
+    size_t step = 1;
+    size_t low  = 0;
+
+    while (step <= size && pred(first[step - 1]))
+    {
+        low = step;
+        step *= 2;
+    }
+
+    return std::partition_point(first + low, first + std::min(step, size), pred);
+}
+
+/*!
+ * Stable insertion sort of [first, last) where [first, sorted) is already sorted <br>
+ * Place of every element is found by binary search
+ */
+template <typename Iterator, typename Comparator>
+void insertionSort(Iterator first, Iterator sorted, Iterator last, Comparator comp)
+{
+    for (Iterator it = sorted; it != last; ++it)
+    {
+        Iterator place = std::upper_bound(first, it, *it, comp);
+        std::rotate(place, it, it + 1);
+    }
+}
+
+/*!
+ * Finds natural run starting at first and makes it at least ADAPTIVE_MIN_RUN long <br>
+ * Strictly descending runs are reversed, so stability is kept
+ * @return End of sorted run
+ */
+template <typename Iterator, typename Comparator>
+Iterator extendRun(Iterator first, Iterator last, Comparator comp)
+{
+    Iterator end = first + 1;
+    if (end == last)
+        return end;
+
+    if (comp(*end++, *first))
+    {
+        while (end != last && comp(*end, *(end - 1)))
+            ++end;
+        std::reverse(first, end);
+    }
+    else
+    {
+        while (end != last && !comp(*end, *(end - 1)))
+            ++end;
+    }
+
+    if ((size_t) (end - first) < ADAPTIVE_MIN_RUN)
+    {
+        Iterator extended = first + std::min<size_t>(ADAPTIVE_MIN_RUN, last - first);
+        insertionSort(first, end, extended, comp);
+        end = extended;
+    }
+
+    return end;
+}
+
+/*!
+ * Stable merge of neighbour sorted runs <br>
+ * Parts of runs which are in place already are skipped by galloping, then <br>
+ * the rest of the left run is moved to buffer and merged, blocks are copied at once <br>
+ * after one run wins ADAPTIVE_MIN_GALLOP times in a row
+ */
+template <typename Iterator, typename Comparator, typename T>
+void mergeRuns(Iterator first, Iterator middle, Iterator last, Comparator comp, std::vector<T>* buffer)
+{
+    first = gallopSearch(first, middle, [&](const T& elem) { return !comp(*middle, elem); });
+    if (first == middle)
+        return;
+
+    const T& leftLast = *(middle - 1);
+    std::reverse_iterator<Iterator> fromEnd(last), toMiddle(middle);
+    last -= gallopSearch(fromEnd, toMiddle, [&](const T& elem) { return !comp(elem, leftLast); }) - fromEnd;
+
+    buffer->assign(std::make_move_iterator(first), std::make_move_iterator(middle));
+    T* left = buffer->data();
+    T* leftEnd = left + buffer->size();
+    Iterator right = middle;
+    Iterator out = first;
+
+    size_t leftWins = 0, rightWins = 0;
+    while (left != leftEnd && right != last)
+    {
+        if (comp(*right, *left))
+        {
+            *out++ = std::move(*right++);
+            leftWins = 0;
+
+            if (++rightWins >= ADAPTIVE_MIN_GALLOP)
+            {
+                Iterator stop = gallopSearch(right, last, [&](const T& elem) { return comp(elem, *left); });
+                out = std::move(right, stop, out);
+                right = stop;
+                rightWins = 0;
+            }
+        }
+        else
+        {
+            *out++ = std::move(*left++);
+            rightWins = 0;
+
+            if (++leftWins >= ADAPTIVE_MIN_GALLOP)
+            {
+                T* stop = gallopSearch(left, leftEnd, [&](const T& elem) { return !comp(*right, elem); });
+                out = std::move(left, stop, out);
+                left = stop;
+                leftWins = 0;
+            }
+        }
+    }
+
+    std::move(left, leftEnd, out);
+}
+
+/*!
+ * Powersort priority of the boundary between neighbour runs: <br>
+ * first bit where binary fractions of their midpoints differ
+ * @param begin, middle, end Runs are [begin, middle) and [middle, end)
+ * @param size Size of the whole range
+ */
+inline unsigned nodePower(size_t begin, size_t middle, size_t end, size_t size)
+{
+    uint64_t left  = begin + middle;  // Doubled midpoints
+    uint64_t right = middle + end;
+    uint64_t whole = 2 * (uint64_t) size;
+    unsigned power = 0;
+
+    while (true)
+    {
+        ++power;
+        left  *= 2;
+        right *= 2;
+
+        bool leftBit = left >= whole, rightBit = right >= whole;
+        if (leftBit != rightBit)
+            return power;
+
+        if (leftBit)
+        {
+            left  -= whole;
+            right -= whole;
+        }
+    }
+}
+
+/*!
+ * Quick check whether range consists of long ascending or descending runs <br>
+ * Looks at neighbours in ADAPTIVE_SAMPLE_WINDOWS evenly spread places, about 500 comparisons
+ * @return true if at least 7 of 8 neighbour pairs are in one order
+ */
+template <typename Iterator, typename Comparator>
+bool looksPresorted(Iterator first, Iterator last, Comparator comp)
+{
+    size_t size = last - first;
+    if (size < ADAPTIVE_MIN_SIZE)
+        return false;
+
+    size_t nAscending = 0, nDescending = 0, nPairs = 0;
+    for (size_t window = 0; window < ADAPTIVE_SAMPLE_WINDOWS; ++window)
+    {
+        Iterator start = first + window * (size - ADAPTIVE_SAMPLE_WINDOW) / (ADAPTIVE_SAMPLE_WINDOWS - 1);
+
+        for (Iterator it = start + 1; it != start + ADAPTIVE_SAMPLE_WINDOW; ++it, ++nPairs)
+        {
+            if (comp(*it, *(it - 1)))
+                ++nDescending;
+            else if (comp(*(it - 1), *it))
+                ++nAscending;
+            else
+            {
+                ++nAscending;
+                ++nDescending;
+            }
+        }
+    }
+
+    return 8 * nAscending >= 7 * nPairs || 8 * nDescending >= 7 * nPairs;
+}
+
+/*!
+ * Stable powersort: natural runs are merged in nearly optimal order <br>
+ * Takes O(n + n H) comparisons where H is entropy of run lengths, <br>
+ * so one sorted or reversed run costs n - 1 comparisons
+ * @param first, last Range to sort
+ * @param comp Strict weak order
+ */
+template <typename Iterator, typename Comparator>
+void adaptiveSort(Iterator first, Iterator last, Comparator comp)
+{
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+
+    struct Run
+    {
+        size_t begin;
+        size_t end;
+        unsigned power;
+    };
+
+    size_t size = last - first;
+    if (size < 2)
+        return;
+
+    std::vector<T> buffer;
+    std::vector<Run> stack;
+
+    Run current = {0, (size_t) (extendRun(first, last, comp) - first), 0};
+    while (current.end < size)
+    {
+        Run next = {current.end, (size_t) (extendRun(first + current.end, last, comp) - first), 0};
+        unsigned power = nodePower(current.begin, next.begin, next.end, size);
+
+        while (!stack.empty() && stack.back().power > power)
+        {
+            mergeRuns(first + stack.back().begin, first + current.begin, first + current.end, comp, &buffer);
+            current.begin = stack.back().begin;
+            stack.pop_back();
+        }
+
+        current.power = power;
+        stack.push_back(current);
+        current = next;
+    }
+
+    while (!stack.empty())
+    {
+        mergeRuns(first + stack.back().begin, first + current.begin, first + current.end, comp, &buffer);
+        current.begin = stack.back().begin;
+        stack.pop_back();
+    }
+}
+
+#endif /* ADAPTIVE_SORT_H_INCLUDED */
@@ -0,0 +1,573 @@
+/*!
+ * \file
+ * \brief
+ * \details Asynchronous chunked file reading and batched writing on top of io_uring <br>
+ * Falls back to plain preadv/pwritev when kernel does not provide io_uring
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef ASYNC_IO_H_INCLUDED
+#define ASYNC_IO_H_INCLUDED
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <climits>
+#include <cerrno>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*!
+ * Size of one read request
+ */
+const size_t IO_CHUNK_SIZE = 1 << 20;
+
+/*!
+ * Maximal number of buffers in one vectored request
+ */
+const size_t IO_MAX_IOVECS = IOV_MAX;
+
+/*!
+ * \brief One vectored read or write at given file offset
+ */
+struct IoRequest
+{
+    const iovec* iov; //!< Buffers to transfer
+    unsigned nIov;    //!< Number of buffers
+    off_t offset;     //!< Position in file
+    size_t bytes;     //!< Total size of buffers
+};
+
+/*!
+ * \brief Minimal io_uring submission and completion rings
+ *
+ * Talks to kernel with raw system calls, so liburing is not needed <br>
+ * If setup fails isOk() returns false and callers should use synchronous calls
+ */
+class IoRing
+{
+private:
+    int fd_;            //!< Ring file descriptor, -1 if io_uring is unavailable
+    unsigned entries_;  //!< Asked number of requests in flight
+    unsigned nFree_;    //!< Number of requests which may be added before completion
+    unsigned pending_;  //!< Number of prepared but not submitted requests
+    unsigned inFlight_; //!< Number of submitted requests not completed yet
+
+    void* sqRing_;      //!< Mapped submission ring
+    size_t sqRingSize_; //!< Size of sqRing_ mapping
+    void* cqRing_;      //!< Mapped completion ring, may coincide with sqRing_
+    size_t cqRingSize_; //!< Size of cqRing_ mapping
+    io_uring_sqe* sqes_; //!< Mapped submission entries
+    size_t sqesSize_;    //!< Size of sqes_ mapping
+
+    unsigned* sqTail_;  //!< Submission ring tail, written by us
+    unsigned* sqMask_;  //!< Submission ring index mask
+    unsigned* sqArray_; //!< Indices of entries in submission ring
+    unsigned* cqHead_;  //!< Completion ring head, written by us
+    unsigned* cqTail_;  //!< Completion ring tail, written by kernel
+    unsigned* cqMask_;  //!< Completion ring index mask
+    io_uring_cqe* cqes_; //!< Completion entries
+
+    /*!
+     * Maps rings described by kernel in params
+     */
+    bool mapRings(const io_uring_params& params)
+    {
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap)
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED)
+        {
+            sqRing_ = nullptr;
+            return false;
+        }
+
+        if (singleMap)
+            cqRing_ = sqRing_;
+        else
+        {
+            cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd_, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED)
+            {
+                cqRing_ = nullptr;
+                return false;
+            }
+        }
+
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = (io_uring_sqe*) mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED)
+        {
+            sqes_ = nullptr;
+            return false;
+        }
+
+        char* sq = (char*) sqRing_;
+        char* cq = (char*) cqRing_;
+        sqTail_  = (unsigned*) (sq + params.sq_off.tail);
+        sqMask_  = (unsigned*) (sq + params.sq_off.ring_mask);
+        sqArray_ = (unsigned*) (sq + params.sq_off.array);
+        cqHead_  = (unsigned*) (cq + params.cq_off.head);
+        cqTail_  = (unsigned*) (cq + params.cq_off.tail);
+        cqMask_  = (unsigned*) (cq + params.cq_off.ring_mask);
+        cqes_    = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+        nFree_ = params.sq_entries;
+        return true;
+    }
+
+    /*!
+     * Unmaps rings and closes descriptor
+     */
+    void release()
+    {
+        if (sqes_)
+            munmap(sqes_, sqesSize_);
+        if (cqRing_ && cqRing_ != sqRing_)
+            munmap(cqRing_, cqRingSize_);
+        if (sqRing_)
+            munmap(sqRing_, sqRingSize_);
+        if (fd_ >= 0)
+            close(fd_);
+
+        sqes_ = nullptr;
+        sqRing_ = cqRing_ = nullptr;
+        fd_ = -1;
+        nFree_ = pending_ = inFlight_ = 0;
+    }
+
+    /*!
+     * Asks kernel for a ring, leaves object in not-ok state on failure
+     */
+    void setup()
+    {
+#ifdef __NR_io_uring_setup
+        io_uring_params params = {};
+        fd_ = (int) syscall(__NR_io_uring_setup, entries_, &params);
+
+        if (fd_ >= 0 && !mapRings(params))
+            release();
+#endif
+    }
+
+    IoRing(const IoRing& that)                   = delete;
+    const IoRing& operator =(const IoRing& that) = delete;
+
+public:
+    /*!
+     * Creates ring or leaves object in not-ok state
+     * @param entries Desired number of requests in flight
+     */
+    explicit IoRing(unsigned entries = 32):
+        fd_(-1),
+        entries_(entries),
+        nFree_(0),
+        pending_(0),
+        inFlight_(0),
+        sqRing_(nullptr),
+        sqRingSize_(0),
+        cqRing_(nullptr),
+        cqRingSize_(0),
+        sqes_(nullptr),
+        sqesSize_(0)
+    {
+        setup();
+    }
+
+    ~IoRing()
+    {
+        release();
+    }
+
+    /*!
+     * Whether kernel gave a working ring
+     */
+    bool isOk() const
+    {
+        return fd_ >= 0;
+    }
+
+    /*!
+     * Number of requests which may be added right now
+     */
+    unsigned getNFree() const
+    {
+        return nFree_;
+    }
+
+    /*!
+     * Number of submitted requests kernel has not completed yet
+     */
+    unsigned getNInFlight() const
+    {
+        return inFlight_;
+    }
+
+    /*!
+     * Puts vectored read or write to submission ring
+     * @param opcode IORING_OP_READV or IORING_OP_WRITEV
+     * @param fd File to work with
+     * @param request Buffers and offset, must live until completion
+     * @param tag Value returned with completion
+     */
+    void prepare(int opcode, int fd, const IoRequest& request, uint64_t tag)
+    {
+        assert(isOk() && nFree_ > 0);
+
+        unsigned tail = *sqTail_;
+        unsigned index = tail & *sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = (uint8_t) opcode;
+        sqe->fd        = fd;
+        sqe->addr      = (uint64_t) (uintptr_t) request.iov;
+        sqe->len       = request.nIov;
+        sqe->off       = (uint64_t) request.offset;
+        sqe->user_data = tag;
+
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+        --nFree_;
+        ++pending_;
+    }
+
+    /*!
+     * Submits prepared requests and waits for some completions
+     * @param nWait Number of completions to wait for
+     * @return false on system call failure
+     */
+    bool submitAndWait(unsigned nWait)
+    {
+#ifdef __NR_io_uring_setup
+        while (true)
+        {
+            long res = syscall(__NR_io_uring_enter, fd_, pending_, nWait, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (res >= 0)
+            {
+                pending_  -= (unsigned) res;
+                inFlight_ += (unsigned) res;
+                return true;
+            }
+
+            if (errno != EINTR)
+                return false;
+        }
+#else
+        // Ring is never set up without io_uring system calls
+        (void) nWait;
+        return false;
+#endif
+    }
+
+    /*!
+     * Waits for completions without submitting anything
+     * @param nWait Number of completions to wait for
+     * @return false on system call failure
+     */
+    bool wait(unsigned nWait)
+    {
+#ifdef __NR_io_uring_setup
+        while (true)
+        {
+            if (syscall(__NR_io_uring_enter, fd_, 0, nWait, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0)
+                return true;
+
+            if (errno != EINTR)
+                return false;
+        }
+#else
+        (void) nWait;
+        return false;
+#endif
+    }
+
+    /*!
+     * Takes back prepared requests kernel has not taken yet <br>
+     * They are the last ones prepared, kernel will never see them
+     * @return Number of withdrawn requests
+     */
+    unsigned withdrawPending()
+    {
+        unsigned nWithdrawn = pending_;
+        __atomic_store_n(sqTail_, *sqTail_ - pending_, __ATOMIC_RELEASE);
+
+        nFree_ += pending_;
+        pending_ = 0;
+        return nWithdrawn;
+    }
+
+    /*!
+     * Closes ring and asks kernel for a new one <br>
+     * Last resort when requests in flight can not be reaped: closing cancels them
+     */
+    void reset()
+    {
+        release();
+        setup();
+    }
+
+    /*!
+     * Takes one completion if there is any
+     * @param tag Place to write tag of completed request
+     * @param result Place to write number of bytes transferred or -errno
+     * @return false if nothing has completed
+     */
+    bool popCompletion(uint64_t* tag, int* result)
+    {
+        assert(tag);
+        assert(result);
+
+        unsigned head = *cqHead_;
+        if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+            return false;
+
+        const io_uring_cqe* cqe = &cqes_[head & *cqMask_];
+        *tag = cqe->user_data;
+        *result = cqe->res;
+
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        ++nFree_;
+        --inFlight_;
+        return true;
+    }
+};
+
+/*!
+ * Ring of calling thread, created on first use
+ * @return nullptr if io_uring is unavailable
+ */
+IoRing* threadIoRing()
+{
+    thread_local IoRing ring;
+    return ring.isOk() ? &ring : nullptr;
+}
+
+/*!
+ * Transfers whole request with blocking preadv/pwritev, continuing after short transfers
+ * @param opcode IORING_OP_READV or IORING_OP_WRITEV
+ * @return false on error or unexpected end of file
+ */
+bool transferSync(int opcode, int fd, const IoRequest& request)
+{
+    std::vector<iovec> iov(request.iov, request.iov + request.nIov);
+    size_t first = 0;
+    off_t offset = request.offset;
+
+    while (first < iov.size())
+    {
+        unsigned nIov = (unsigned) std::min(iov.size() - first, IO_MAX_IOVECS);
+        ssize_t done = (opcode == IORING_OP_READV) ? preadv (fd, &iov[first], nIov, offset)
+                                                   : pwritev(fd, &iov[first], nIov, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return false;
+
+        offset += done;
+        while (first < iov.size() && (size_t) done >= iov[first].iov_len)
+            done -= iov[first++].iov_len;
+
+        if (first < iov.size())
+        {
+            iov[first].iov_base = (char*) iov[first].iov_base + done;
+            iov[first].iov_len -= done;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Runs all requests keeping the ring full
+ * Short transfers are finished synchronously <br>
+ * Without ring every request is done with transferSync <br>
+ * If the ring fails, nothing is left in flight on return: requests kernel has not <br>
+ * taken are withdrawn, taken ones are reaped (or cancelled by reset() when even <br>
+ * waiting fails), and every request without a full completion is done with transferSync
+ * @param ring Ring to use or nullptr
+ * @param opcode IORING_OP_READV or IORING_OP_WRITEV
+ * @return Whether every request transferred all its bytes
+ */
+bool transferAll(IoRing* ring, int opcode, int fd, const std::vector<IoRequest>& requests)
+{
+    bool ok = true;
+    std::vector<char> isDone(requests.size(), false);
+
+    size_t next = 0;
+    bool isBroken = false;
+    while (ring && (ring->getNInFlight() > 0 || (!isBroken && next < requests.size())))
+    {
+        while (!isBroken && next < requests.size() && ring->getNFree() > 0)
+        {
+            ring->prepare(opcode, fd, requests[next], next);
+            ++next;
+        }
+
+        if (!(isBroken ? ring->wait(1) : ring->submitAndWait(1)))
+        {
+            if (isBroken)
+            {
+                ring->reset();
+                break;
+            }
+
+            ring->withdrawPending();
+            isBroken = true;
+            continue;
+        }
+
+        uint64_t tag = 0;
+        int result = 0;
+        while (ring->popCompletion(&tag, &result))
+        {
+            isDone[tag] = true;
+            if (result < 0 || (size_t) result < requests[tag].bytes)
+                ok = transferSync(opcode, fd, requests[tag]) && ok;
+        }
+    }
+
+    for (size_t i = 0; i < requests.size(); ++i)
+        if (!isDone[i])
+            ok = transferSync(opcode, fd, requests[i]) && ok;
+
+    return ok;
+}
+
+/*!
+ * Reads file with large chunks submitted at once
+ * @param filename Path to file
+ * @param buffer Place to read to
+ * @param bytes Number of bytes to read
+ * @param ring Ring to use, nullptr for plain preadv
+ * @return Whether all bytes were read
+ */
+bool readFileChunked(const char* filename, void* buffer, size_t bytes, IoRing* ring)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    size_t nChunks = (bytes + IO_CHUNK_SIZE - 1) / IO_CHUNK_SIZE;
+    std::vector<iovec> chunks(nChunks);
+    std::vector<IoRequest> requests(nChunks);
+
+    for (size_t i = 0; i < nChunks; ++i)
+    {
+        size_t offset = i * IO_CHUNK_SIZE;
+        chunks[i].iov_base = (char*) buffer + offset;
+        chunks[i].iov_len  = std::min(IO_CHUNK_SIZE, bytes - offset);
+        requests[i] = { &chunks[i], 1, (off_t) offset, chunks[i].iov_len };
+    }
+
+    bool ok = transferAll(ring, IORING_OP_READV, fd, requests);
+    close(fd);
+    return ok;
+}
+
+/*!
+ * \brief Whole output of a file gathered before writing
+ *
+ * Stores only pointers to pieces, nothing is copied <br>
+ * Pieces are grouped into vectored writes at precomputed offsets, <br>
+ * so all of them are in flight at once
+ */
+class OutputBatch
+{
+private:
+    std::vector<iovec> pieces_;      //!< Pieces of output in order
+    std::deque<std::string> owned_;  //!< Pieces stored inside batch
+    size_t bytes_;                   //!< Total size of pieces
+
+public:
+    OutputBatch():
+        bytes_(0)
+    {}
+
+    /*!
+     * Appends piece of memory to output
+     * @param data Memory which must live until write()
+     * @param size Number of bytes
+     */
+    void add(const void* data, size_t size)
+    {
+        if (size == 0)
+            return;
+
+        pieces_.push_back({ const_cast<void*>(data), size });
+        bytes_ += size;
+    }
+
+    /*!
+     * Appends piece built for this output only, batch keeps it alive
+     * @param data Contents of piece
+     */
+    void addOwned(std::string&& data)
+    {
+        owned_.push_back(std::move(data));
+        add(owned_.back().data(), owned_.back().size());
+    }
+
+    size_t getNBytes() const { return bytes_; }
+
+    /*!
+     * Forgets all pieces
+     */
+    void clear()
+    {
+        pieces_.clear();
+        owned_.clear();
+        bytes_ = 0;
+    }
+
+    /*!
+     * Writes all pieces to file, creating or truncating it
+     * @param filename Path to output
+     * @param ring Ring to use, nullptr for plain pwritev
+     * @return Whether everything was written
+     */
+    bool write(const char* filename, IoRing* ring) const
+    {
+        int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        std::vector<IoRequest> requests;
+        size_t offset = 0;
+
+        for (size_t first = 0; first < pieces_.size(); first += IO_MAX_IOVECS)
+        {
+            unsigned nIov = (unsigned) std::min(IO_MAX_IOVECS, pieces_.size() - first);
+            size_t size = 0;
+            for (size_t i = first; i < first + nIov; ++i)
+                size += pieces_[i].iov_len;
+
+            requests.push_back({ &pieces_[first], nIov, (off_t) offset, size });
+            offset += size;
+        }
+
+        bool ok = transferAll(ring, IORING_OP_WRITEV, fd, requests);
+        return (close(fd) == 0) && ok;
+    }
+};
+
+#endif /* ASYNC_IO_H_INCLUDED */
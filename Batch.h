@@ -0,0 +1,444 @@
+/*!
+ * \file
+ * \brief
+ * \details Sorting of many files in one process with a fixed pool of workers
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include "Text.h"
+#include "Collation.h"
+#include "LineTable.h"
+#include "KeyPointerSort.h"
+#include "FieldKeys.h"
+#include "NaturalOrder.h"
+#include <thread>
+#include <atomic>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+/*!
+ * \brief Which versions of text to print and how
+ */
+struct PrintOptions
+{
+    bool needOrig = true;      //!< Whether to print original version
+    bool needSort = true;      //!< Whether to print sorted version
+    bool needRev  = true;      //!< Whether to print reverse-sorted version
+    size_t top    = 0;         //!< Number of first lines in sorted versions, 0 for all
+    bool collate  = false;     //!< Whether to sort in linguistic order by collation keys
+    unsigned fold = FOLD_NONE; //!< Differences ignored by collation, see FoldFlags
+    bool unique   = false;     //!< Whether to leave only the first of equivalent lines
+    bool stable   = false;     //!< Whether equivalent lines keep original order
+    bool lineTable = false;    //!< Whether to sort with struct-of-arrays line table, it is stable too
+    bool keySort  = false;     //!< Whether to sort normalized keys kept in one arena, it is stable too
+    bool natural  = false;     //!< Whether runs of digits are compared as numbers
+    std::vector<FieldKey> fieldKeys; //!< Keys of sorting by fields, whole lines are compared if empty
+
+    /*!
+     * Number of lines to print in sorted versions
+     */
+    size_t getSortedLimit() const
+    {
+        return top ? top : SIZE_MAX;
+    }
+};
+
+/*!
+ * Sorts text for one of sorted versions <br>
+ * Only first lines are sorted if options ask for top
+ * @param text Text to sort
+ * @param comp Comparator of lines
+ * @param options Options of printing
+ */
+template <typename CharT, typename Comparator>
+void sortVersion(BasicText<CharT>& text, Comparator comp, const PrintOptions& options)
+{
+    if (options.top)
+        text.partialSort(options.top, comp);
+    else
+        text.sort(comp);
+}
+
+/*!
+ * Sorts text for forward or backward sorted version <br>
+ * Uses key fields, natural or collation keys if options ask for them, otherwise comparators of lines <br>
+ * Stable sorting starts from original order, so output does not depend on previous versions <br>
+ * Every mode sorts only first lines if options ask for top
+ * @param text Text to sort
+ * @param reversed Whether to sort by line endings
+ * @param options Options of printing
+ * @param fields Table of key fields kept between sorts of the same text, it is built <br>
+ *               on the first sort by fields. Fields are located for this sort only if nullptr
+ */
+template <typename CharT>
+void sortDirection(BasicText<CharT>& text, bool reversed, const PrintOptions& options,
+                   BasicFieldTable<CharT>* fields = nullptr)
+{
+    if (options.stable)
+        text.recoverOriginal();
+
+    if (!options.fieldKeys.empty())
+    {
+        BasicFieldTable<CharT> local;
+        if (!fields)
+            fields = &local;
+
+        if (!fields->isBuilt())
+        {
+            text.recoverOriginal();
+            fields->build(text, options.fieldKeys);
+        }
+
+        sortByFields(text, *fields, reversed, options.getSortedLimit());
+    }
+    else if (options.natural)
+        sortNatural(text, reversed, options.getSortedLimit());
+    else if (options.collate)
+        collate(text, reversed, options.getSortedLimit(), options.fold);
+    else if (options.lineTable)
+        sortByLineTable(text, reversed, options.getSortedLimit());
+    else if (options.keySort)
+        sortByKeyPointers(text, reversed, options.getSortedLimit());
+    else if (options.stable)
+        text.stableSort(reversed, options.getSortedLimit());
+    else if (reversed)
+        sortVersion(text, reverseStringComparator, options);
+    else
+        sortVersion(text, std::less<typename BasicText<CharT>::String>(), options);
+}
+
+/*!
+ * Brings text to every asked version one after another and hands it to consumer
+ * @param text Text to work with
+ * @param options Which versions are needed
+ * @param consume Callable taking text and maximal number of its first lines to output
+ * @param sort Callable taking text and direction, puts text into sorted order
+ */
+template <typename CharT, typename Consumer, typename Sorter>
+void produceVersions(BasicText<CharT>& text, const PrintOptions& options, Consumer consume, Sorter sort)
+{
+    assert(text.isOk());
+
+    if (options.unique)
+        text.removeDuplicates();
+
+    if (options.needSort)
+    {
+        sort(text, false);
+        consume(text, options.getSortedLimit());
+    }
+
+    if (options.needRev)
+    {
+        sort(text, true);
+        consume(text, options.getSortedLimit());
+    }
+
+    if (options.needOrig)
+    {
+        text.recoverOriginal();
+        consume(text, SIZE_MAX);
+    }
+}
+
+/*!
+ * Same as above, text is sorted by sortDirection <br>
+ * Key fields are located once and serve both sorted versions
+ */
+template <typename CharT, typename Consumer>
+void produceVersions(BasicText<CharT>& text, const PrintOptions& options, Consumer consume)
+{
+    BasicFieldTable<CharT> fields;
+    produceVersions(text, options, consume, [&options, &fields](BasicText<CharT>& version, bool reversed)
+    {
+        sortDirection(version, reversed, options, &fields);
+    });
+}
+
+/*!
+ * Prints asked versions of text to output one after another
+ * @param text Text to print
+ * @param output File to print in
+ * @param options Which versions to print
+ */
+template <typename CharT>
+void printFiles(BasicText<CharT>& text, FILE* output, const PrintOptions& options = PrintOptions())
+{
+    assert(output);
+
+    produceVersions(text, options, [output](const BasicText<CharT>& version, size_t maxLines)
+    {
+        version.printToFile(output, maxLines);
+    });
+}
+
+/*!
+ * Same as printFiles, but all versions are written with one batch of <br>
+ * asynchronous vectored writes after sorting
+ * @param text Text to print
+ * @param outputFilename Path to output file
+ * @param options Which versions to print
+ * @return Whether output was written
+ * @see printFiles
+ */
+template <typename CharT>
+bool writeFilesAsync(BasicText<CharT>& text, const char* outputFilename, const PrintOptions& options = PrintOptions())
+{
+    assert(outputFilename);
+
+    OutputBatch batch;
+    produceVersions(text, options, [&batch](const BasicText<CharT>& version, size_t maxLines)
+    {
+        version.collectOutput(&batch, maxLines);
+    });
+
+    return batch.write(outputFilename, threadIoRing());
+}
+
+/*!
+ * \brief List of files to sort with their outputs
+ */
+class FileList
+{
+private:
+    std::vector<std::string> inputs_;  //!< Files to sort
+    std::vector<std::string> outputs_; //!< Where to write each of inputs_
+
+public:
+    /*!
+     * Suffix appended to input name when output is not given explicitly
+     */
+    static constexpr const char* DEFAULT_SUFFIX = ".sorted";
+
+    /*!
+     * Adds file to the list
+     * @param input Path to file to sort
+     * @param output Path to write result, input with DEFAULT_SUFFIX if nullptr
+     */
+    void addFile(const char* input, const char* output = nullptr)
+    {
+        assert(input);
+        inputs_.push_back(input);
+        outputs_.push_back(output ? std::string(output) : inputs_.back() + DEFAULT_SUFFIX);
+    }
+
+    /*!
+     * Reads list of files to sort <br>
+     * Each line holds input path and optionally output path separated by whitespace
+     * @param listFilename Path to list
+     * @return false if list can not be opened
+     */
+    bool addList(const char* listFilename)
+    {
+        std::ifstream list(listFilename);
+        if (!list)
+            return false;
+
+        std::string line;
+        while (std::getline(list, line))
+        {
+            std::istringstream fields(line);
+            std::string input, output;
+
+            if (!(fields >> input))
+                continue;
+
+            if (fields >> output)
+                addFile(input.c_str(), output.c_str());
+            else
+                addFile(input.c_str());
+        }
+
+        return true;
+    }
+
+    size_t size() const { return inputs_.size(); }
+
+    /*!
+     * Input path of i-th file in the list
+     */
+    const char* getInput(size_t index) const
+    {
+        ASSERT(index < inputs_.size(), "Out of batch files range");
+        return inputs_[index].c_str();
+    }
+
+    /*!
+     * Output path of i-th file in the list
+     */
+    const char* getOutput(size_t index) const
+    {
+        ASSERT(index < outputs_.size(), "Out of batch files range");
+        return outputs_[index].c_str();
+    }
+};
+
+/*!
+ * \brief Sorts a list of files using several threads
+ *
+ * Each worker owns one Text and takes next file from the common list <br>
+ * Memory of Text is reused between files, so only the largest file costs allocation <br>
+ * Every output is exactly the same as produced by a separate run
+ */
+class BatchSorter
+{
+private:
+    const FileList* files_;       //!< Files being sorted by run()
+    std::atomic<size_t> nextJob_; //!< Index of the first file not taken yet
+    std::atomic<size_t> nWritten_; //!< Number of files written by run()
+
+    size_t nWorkers_; //!< Number of threads in pool
+    PrintOptions options_; //!< Versions to print for each file
+    bool hugePages_;  //!< Whether workers back texts with 2 MB pages
+    bool asyncIO_;    //!< Whether workers use io_uring
+    bool utf8Direct_; //!< Whether workers sort UTF-8 without conversion
+    TextEncoding inputEncoding_;  //!< Encoding of input files
+    TextEncoding outputEncoding_; //!< Encoding of output files
+
+    /*!
+     * Worker loop: takes files one by one until the list is over
+     * @tparam TextT Text, Utf8Text or Utf32Text
+     */
+    template <typename TextT>
+    void work()
+    {
+        TextT text;
+        text.useHugePages(hugePages_);
+        text.useAsyncIO(asyncIO_);
+        text.setEncodings(inputEncoding_, outputEncoding_);
+
+        size_t job = 0;
+        while ((job = nextJob_++) < files_->size())
+        {
+            // Unreadable input is skipped, its output is not touched
+            if (!text.readRawFromFile(files_->getInput(job)))
+            {
+                fprintf(stderr, "Unable to read file: %s\n", files_->getInput(job));
+                continue;
+            }
+
+            text.splitLines();
+
+            if (asyncIO_)
+            {
+                if (writeFilesAsync(text, files_->getOutput(job), options_))
+                    ++nWritten_;
+                else
+                    fprintf(stderr, "Unable to write file %s\n", files_->getOutput(job));
+                continue;
+            }
+
+            FILE* output = fopen(files_->getOutput(job), "wb");
+            if (!output)
+            {
+                fprintf(stderr, "Unable to open file %s for output\n", files_->getOutput(job));
+                continue;
+            }
+
+            printFiles(text, output, options_);
+            fclose(output);
+            ++nWritten_;
+        }
+    }
+
+    BatchSorter(const BatchSorter& that)                   = delete;
+    const BatchSorter& operator =(const BatchSorter& that) = delete;
+
+public:
+    /*!
+     * @param nWorkers Number of threads, 0 means number of cores
+     */
+    explicit BatchSorter(size_t nWorkers = 0):
+        files_(nullptr),
+        nextJob_(0),
+        nWritten_(0),
+        nWorkers_(nWorkers ? nWorkers : std::max(1u, std::thread::hardware_concurrency())),
+        options_(),
+        hugePages_(false),
+        asyncIO_(false),
+        utf8Direct_(false),
+        inputEncoding_(ENCODING_UTF16),
+        outputEncoding_(ENCODING_UTF16)
+    {}
+
+    /*!
+     * Chooses versions to print for each file
+     * @see printFiles
+     */
+    void setPrintOptions(const PrintOptions& options)
+    {
+        options_ = options;
+    }
+
+    /*!
+     * @see Text::useHugePages
+     */
+    void useHugePages(bool enable = true)
+    {
+        hugePages_ = enable;
+    }
+
+    /*!
+     * @see Text::useAsyncIO, writeFilesAsync
+     */
+    void useAsyncIO(bool enable = true)
+    {
+        asyncIO_ = enable;
+    }
+
+    /*!
+     * @see Text::setEncodings
+     */
+    void setEncodings(TextEncoding input, TextEncoding output)
+    {
+        inputEncoding_  = input;
+        outputEncoding_ = output;
+    }
+
+    /*!
+     * Asks workers to use Utf8Text instead of Text
+     */
+    void useUtf8Direct(bool enable = true)
+    {
+        utf8Direct_ = enable;
+    }
+
+    size_t getNWorkers() const { return nWorkers_; }
+
+    /*!
+     * Sorts all files of the list and returns when everything is written
+     * @param files Files to sort
+     * @return Number of files written, skipped inputs are not counted
+     */
+    size_t run(const FileList& files)
+    {
+        files_ = &files;
+        nextJob_  = 0;
+        nWritten_ = 0;
+
+        void (BatchSorter::*work)() = &BatchSorter::work<Text>;
+        if (utf8Direct_)
+            work = &BatchSorter::work<Utf8Text>;
+        else if (inputEncoding_ == ENCODING_UTF32)
+            work = &BatchSorter::work<Utf32Text>;
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < std::min(nWorkers_, files.size()); ++i)
+            workers.emplace_back(work, this);
+
+        (this->*work)();
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        files_ = nullptr;
+        return nWritten_;
+    }
+};
+
+#endif /* BATCH_H_INCLUDED */
@@ -0,0 +1,391 @@
+/*!
+ * \file
+ * \brief
+ * \details Linguistic order of lines: collation keys built once per line and compared as bytes
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef COLLATION_H_INCLUDED
+#define COLLATION_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * Differences of symbols ignored by collation
+ */
+enum FoldFlags
+{
+    FOLD_NONE    = 0, //!< Every difference matters
+    FOLD_CASE    = 1, //!< "Онегин" and "онегин" are equal
+    FOLD_ACCENTS = 2  //!< "ёж" and "еж", "école" and "ecole" are equal
+};
+
+/*!
+ * \brief Lowercase and unaccented forms of Latin and Cyrillic letters
+ *
+ * Two arrays of 16-bit symbols for all code points below U+0500, <br>
+ * symbols above are left as they are. Built once on the first use
+ */
+class FoldTable
+{
+private:
+    static const uint32_t SIZE_ = 0x500; //!< Number of code points in table
+
+    char16_t lower_[SIZE_]; //!< Lowercase form of every symbol
+    char16_t base_[SIZE_];  //!< Letter without accents, case is kept
+
+    FoldTable()
+    {
+        for (uint32_t code = 0; code < SIZE_; ++code)
+            lower_[code] = base_[code] = char16_t(code);
+
+        for (uint32_t code = 'A'; code <= 'Z'; ++code)
+            lower_[code] = char16_t(code + 0x20);
+
+        for (uint32_t code = 0xc0; code <= 0xde; ++code)
+            if (code != 0xd7)
+                lower_[code] = char16_t(code + 0x20);
+
+        for (uint32_t code = 0x100; code < 0x180; ++code)
+        {
+            bool evenUpper = (code <= 0x137) || (code >= 0x14a && code <= 0x177);
+            bool oddUpper  = (code >= 0x139 && code <= 0x148) || (code >= 0x179 && code <= 0x17e);
+
+            if ((evenUpper && code % 2 == 0) || (oddUpper && code % 2 == 1))
+                lower_[code] = char16_t(code + 1);
+        }
+        lower_[0x130] = 'i';
+        lower_[0x178] = 0xff;
+
+        for (uint32_t code = 0x400; code < 0x410; ++code)
+            lower_[code] = char16_t(code + 0x50);
+
+        for (uint32_t code = 0x410; code < 0x430; ++code)
+            lower_[code] = char16_t(code + 0x20);
+
+        for (uint32_t code = 0x460; code < SIZE_; ++code)
+        {
+            bool evenUpper = (code <= 0x481) || (code >= 0x48a && code <= 0x4bf) || code >= 0x4d0;
+            bool oddUpper  = (code >= 0x4c1 && code <= 0x4ce);
+
+            if ((evenUpper && code % 2 == 0) || (oddUpper && code % 2 == 1))
+                lower_[code] = char16_t(code + 1);
+        }
+        lower_[0x4c0] = 0x4cf;
+
+        const char* latin1 = "AAAAAAACEEEEIIII" "DNOOOOO\0OUUUUYTs"
+                             "aaaaaaaceeeeiiii" "dnooooo\0ouuuuyty";
+        for (uint32_t code = 0xc0; code <= 0xff; ++code)
+            if (latin1[code - 0xc0])
+                base_[code] = char16_t(latin1[code - 0xc0]);
+
+        const char* latinExtended = "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGgGgGgHhHhIiIiIiIiIiIiJjKkk"
+                                    "LlLlLlLlLlNnNnNnnNnOoOoOoOoRrRrRrSsSsSsSsTtTtTtUuUuUuUuUuUu"
+                                    "WwYyYZzZzZzs";
+        for (uint32_t code = 0x100; code < 0x180; ++code)
+            base_[code] = char16_t(latinExtended[code - 0x100]);
+
+        const uint32_t CYRILLIC_ACCENTED[][2] = { {0x400, 0x415}, {0x401, 0x415}, {0x403, 0x413},
+                                                  {0x407, 0x406}, {0x40c, 0x41a}, {0x40d, 0x418},
+                                                  {0x40e, 0x423} };
+        for (const uint32_t* pair : CYRILLIC_ACCENTED)
+        {
+            base_[pair[0]]        = char16_t(pair[1]);
+            base_[pair[0] + 0x50] = char16_t(lower_[pair[1]]);
+        }
+    }
+
+    FoldTable(const FoldTable& that)                   = delete;
+    const FoldTable& operator =(const FoldTable& that) = delete;
+
+public:
+    /*!
+     * The only table, built on the first call
+     */
+    static const FoldTable& get()
+    {
+        static const FoldTable table;
+        return table;
+    }
+
+    uint32_t toLower(uint32_t code) const
+    {
+        return code < SIZE_ ? lower_[code] : code;
+    }
+
+    uint32_t toBase(uint32_t code) const
+    {
+        return code < SIZE_ ? base_[code] : code;
+    }
+
+    /*!
+     * Folds symbol according to flags
+     * @param code Code point
+     * @param flags Combination of FoldFlags
+     */
+    uint32_t fold(uint32_t code, unsigned flags) const
+    {
+        if (flags & FOLD_ACCENTS)
+            code = toBase(code);
+        if (flags & FOLD_CASE)
+            code = toLower(code);
+
+        return code;
+    }
+};
+
+/*!
+ * \brief Weights of one symbol on three levels of comparison
+ *
+ * Primary weight tells letters apart, secondary one tells accents, tertiary one tells case <br>
+ * Zero weight is skipped on its level
+ */
+struct CollationElement
+{
+    unsigned primary;   //!< Base letter
+    unsigned secondary; //!< Accent
+    unsigned tertiary;  //!< Case
+};
+
+/*!
+ * \brief Builds collation keys of lines with built-in table for Latin and Cyrillic
+ *
+ * Order is close to the one of Unicode Collation Algorithm for these scripts: <br>
+ * punctuation, digits, Latin, Cyrillic, then everything else by code point. <br>
+ * "Ё" goes right after "Е", accented Latin letters go after their base letters, <br>
+ * and lines different only in case are neighbours with lowercase first <br>
+ * Key holds all primary weights, then all secondary, then all tertiary ones, <br>
+ * so plain byte comparison of keys compares lines level by level <br>
+ * Folded differences are removed from symbols before lookup, and levels <br>
+ * which can not differ any more are not stored at all
+ */
+class Collator
+{
+private:
+    static const unsigned LEVEL_SEPARATOR_ = 0;      //!< Less than any weight, ends a level
+    static const unsigned DEFAULT_WEIGHT_  = 0x05;   //!< Secondary and tertiary weight of plain lowercase letter
+    static const unsigned UPPER_WEIGHT_    = 0x06;   //!< Tertiary weight of uppercase letter
+    static const unsigned DIGITS_BASE_     = 0x0100; //!< Primary weight of '0'
+    static const unsigned LATIN_BASE_      = 0x0200; //!< Primary weight of 'a'
+    static const unsigned CYRILLIC_BASE_   = 0x0300; //!< Primary weight of 'а'
+    static const unsigned IMPLICIT_BASE_   = 0xfb00; //!< First weight of symbols out of table
+
+
+    /*!
+     * Accents of Latin-1 letters, secondary weight is DEFAULT_WEIGHT_ plus accent
+     */
+    enum Accent
+    {
+        ACCENT_NONE,
+        ACCENT_GRAVE,
+        ACCENT_ACUTE,
+        ACCENT_CIRCUMFLEX,
+        ACCENT_TILDE,
+        ACCENT_DIAERESIS,
+        ACCENT_RING,
+        ACCENT_CEDILLA,
+        ACCENT_STROKE,
+        ACCENT_LIGATURE,
+        ACCENT_OTHER    //!< Accents out of Latin-1, code point is added to tell them apart
+    };
+
+    const FoldTable& table_; //!< Forms of letters
+    unsigned fold_;          //!< Combination of FoldFlags
+
+    std::vector<uint32_t> codePoints_;       //!< Symbols of line being processed
+    std::vector<CollationElement> elements_; //!< Weights of line being processed
+
+    /*!
+     * Accents of U+00C0 - U+00FF
+     */
+    static Accent latin1Accent(uint32_t code)
+    {
+        static const unsigned char ACCENTS[32] = {
+            ACCENT_GRAVE, ACCENT_ACUTE, ACCENT_CIRCUMFLEX, ACCENT_TILDE,
+            ACCENT_DIAERESIS, ACCENT_RING, ACCENT_LIGATURE, ACCENT_CEDILLA,
+            ACCENT_GRAVE, ACCENT_ACUTE, ACCENT_CIRCUMFLEX, ACCENT_DIAERESIS,
+            ACCENT_GRAVE, ACCENT_ACUTE, ACCENT_CIRCUMFLEX, ACCENT_DIAERESIS,
+            ACCENT_STROKE, ACCENT_TILDE, ACCENT_GRAVE, ACCENT_ACUTE,
+            ACCENT_CIRCUMFLEX, ACCENT_TILDE, ACCENT_DIAERESIS, ACCENT_NONE,
+            ACCENT_STROKE, ACCENT_GRAVE, ACCENT_ACUTE, ACCENT_CIRCUMFLEX,
+            ACCENT_DIAERESIS, ACCENT_ACUTE, ACCENT_STROKE, ACCENT_LIGATURE
+        };
+
+        return (Accent) ACCENTS[(code - 0xc0) % 32];
+    }
+
+    /*!
+     * Secondary weight of accented lowercase letter
+     */
+    static unsigned accentWeight(uint32_t lower)
+    {
+        if (lower >= 0xc0 && lower <= 0xff)
+            return DEFAULT_WEIGHT_ + latin1Accent(lower);
+        if (lower == 0x451)
+            return DEFAULT_WEIGHT_ + ACCENT_DIAERESIS;
+
+        return DEFAULT_WEIGHT_ + ACCENT_OTHER + (lower & 0x3ff);
+    }
+
+    /*!
+     * Appends weights of symbol to elements_ <br>
+     * Ignored symbols give nothing, symbols out of table give two elements
+     * @param code Code point, already folded
+     */
+    void lookup(uint32_t code)
+    {
+        if (code < 0x20 || (code >= 0x7f && code < 0xa0) ||
+            BasicIntegratedString<char32_t>::isProhibitedSymbol(char32_t(code)))
+        {
+            return;
+        }
+
+        uint32_t lower = table_.toLower(code);
+        uint32_t base  = table_.toBase(lower);
+
+        unsigned secondary = (base != lower) ? accentWeight(lower) : DEFAULT_WEIGHT_;
+        unsigned tertiary  = (lower != code) ? UPPER_WEIGHT_ : DEFAULT_WEIGHT_;
+
+        if (base >= '0' && base <= '9')
+            elements_.push_back({DIGITS_BASE_ + (base - '0'), secondary, tertiary});
+
+        else if (base >= 'a' && base <= 'z')
+            elements_.push_back({LATIN_BASE_ + (base - 'a'), secondary, tertiary});
+
+        else if (base >= 0x430 && base <= 0x44f)
+            elements_.push_back({CYRILLIC_BASE_ + (base - 0x430), secondary, tertiary});
+
+        else if (code < 0x80)
+            elements_.push_back({0x10 + (code - 0x20), secondary, tertiary});
+
+        else if (code >= 0xa0 && code <= 0xbf)
+            elements_.push_back({0x70 + (code - 0xa0), secondary, tertiary});
+
+        else if (code >= 0x2000 && code <= 0x206f)
+            elements_.push_back({0x90 + (code - 0x2000), secondary, tertiary});
+
+        else
+        {
+            elements_.push_back({IMPLICIT_BASE_ + (code >> 15), secondary, tertiary});
+            elements_.push_back({0x8000 | (code & 0x7fff), 0, 0});
+        }
+    }
+
+    /*!
+     * Decodes line into codePoints_
+     */
+    void decode(const char* units, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*) units;
+        size_t length = 1;
+
+        for (size_t i = 0; i < size; i += length)
+            codePoints_.push_back(utf8_decode(bytes + i, size - i, &length));
+    }
+
+    void decode(const char16_t* units, size_t size)
+    {
+        for (size_t i = 0; i < size; )
+            codePoints_.push_back(CodeUnitTraits<char16_t>::readCodePoint(units, 0, size, &i, 1));
+    }
+
+    void decode(const char32_t* units, size_t size)
+    {
+        codePoints_.insert(codePoints_.end(), units, units + size);
+    }
+
+    Collator(const Collator& that)                   = delete;
+    const Collator& operator =(const Collator& that) = delete;
+
+public:
+    /*!
+     * @param fold Combination of FoldFlags: differences to ignore
+     */
+    explicit Collator(unsigned fold = FOLD_NONE):
+        table_(FoldTable::get()),
+        fold_(fold),
+        codePoints_(),
+        elements_()
+    {}
+
+    /*!
+     * Appends collation key of line to arena and closes it
+     * @param line Line to build key for
+     * @param reversed Whether key is for backward order, symbols are then taken from the end
+     * @param keys Arena to append to
+     */
+    template <typename CharT>
+    void appendKey(const BasicIntegratedString<CharT>& line, bool reversed, SortKeyArena* keys)
+    {
+        assert(keys);
+
+        codePoints_.clear();
+        decode(line.getPtr(), line.getSize());
+
+        if (reversed)
+            std::reverse(codePoints_.begin(), codePoints_.end());
+
+        elements_.clear();
+        for (uint32_t code : codePoints_)
+            lookup(table_.fold(code, fold_));
+
+        for (const CollationElement& element : elements_)
+            keys->appendWeight(element.primary);
+
+        if (!(fold_ & FOLD_ACCENTS))
+        {
+            keys->appendWeight(LEVEL_SEPARATOR_);
+            for (const CollationElement& element : elements_)
+                if (element.secondary)
+                    keys->appendWeight(element.secondary);
+        }
+
+        if (!(fold_ & FOLD_CASE))
+        {
+            keys->appendWeight(LEVEL_SEPARATOR_);
+            for (const CollationElement& element : elements_)
+                if (element.tertiary)
+                    keys->appendWeight(element.tertiary);
+        }
+
+        keys->closeKey();
+    }
+
+    /*!
+     * Builds keys of all lines of text in current order
+     * @param text Text to build keys for
+     * @param reversed Whether keys are for backward order
+     * @param keys Arena to fill, previous keys are dropped
+     */
+    template <typename CharT>
+    void buildKeys(const BasicText<CharT>& text, bool reversed, SortKeyArena* keys)
+    {
+        assert(keys);
+
+        keys->clear();
+        keys->reserve(text.getNLines(), 6 * text.getNSymbols());
+
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            appendKey(text[i], reversed, keys);
+    }
+};
+
+/*!
+ * Sorts text in linguistic order
+ * @param text Text to sort
+ * @param reversed Whether to sort by line endings like reverseStringComparator
+ * @param k Number of first lines to sort
+ * @param fold Combination of FoldFlags: differences to ignore
+ */
+template <typename CharT>
+void collate(BasicText<CharT>& text, bool reversed, size_t k = SIZE_MAX, unsigned fold = FOLD_NONE)
+{
+    Collator collator(fold);
+    SortKeyArena keys;
+
+    collator.buildKeys(text, reversed, &keys);
+    text.sortByKeys(keys, k);
+}
+
+#endif /* COLLATION_H_INCLUDED */
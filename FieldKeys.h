@@ -0,0 +1,287 @@
+/*!
+ * \file
+ * \brief
+ * \details Sorting by whitespace-separated fields of lines, as sort -k does
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef FIELD_KEYS_H_INCLUDED
+#define FIELD_KEYS_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * \brief One key of field sorting
+ */
+struct FieldKey
+{
+    size_t field;    //!< Number of field, from 1
+    bool numeric;    //!< Whether field is compared as a number
+    bool descending; //!< Whether order of this key is inverted
+};
+
+/*!
+ * Reads key in form of sort -k: number of field followed by letters <br>
+ * n for numeric comparison and r for descending order, e.g. "2" or "3nr"
+ * @param spec Text of key
+ * @param key Place for result
+ * @return false if spec is not a key
+ */
+inline bool parseFieldKey(const char* spec, FieldKey* key)
+{
+    assert(spec);
+    assert(key);
+
+    char* end = nullptr;
+    unsigned long field = strtoul(spec, &end, 10);
+    if (end == spec || field == 0)
+        return false;
+
+    FieldKey parsed = {field, false, false};
+    for (; *end; ++end)
+    {
+        if (*end == 'n')
+            parsed.numeric = true;
+        else if (*end == 'r')
+            parsed.descending = true;
+        else
+            return false;
+    }
+
+    *key = parsed;
+    return true;
+}
+
+/*!
+ * \brief Key fields of every line, located once
+ *
+ * For every line and key the field is stored as pair of its offset in line and length, <br>
+ * numeric keys also keep the parsed value, so comparisons neither scan lines for <br>
+ * separators nor parse numbers. Fields are runs of symbols between spaces and tabs, <br>
+ * missing fields are empty. Text fields are compared as lines are, with service <br>
+ * symbols skipped, numeric ones by value with non-numbers as 0 <br>
+ * Table refers to lines of text, so text must outlive it
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicFieldTable
+{
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of lines
+
+private:
+    std::vector<FieldKey> keys_;  //!< Keys in order of priority
+    std::vector<String> lines_;   //!< Lines in original order
+    std::vector<uint32_t> spans_; //!< Offset and length of every key field, 2 * keys_.size() per line
+    std::vector<double> values_;  //!< Value of every key field, keys_.size() per line, 0 for text keys
+
+    static bool isBlank(CharT sym)
+    {
+        return sym == CharT(' ') || sym == CharT('\t');
+    }
+
+    static bool isDigit(CharT sym)
+    {
+        return sym >= CharT('0') && sym <= CharT('9');
+    }
+
+    /*!
+     * Leading number of field: optional sign, digits and fraction
+     */
+    static double parseNumber(const CharT* ptr, size_t size)
+    {
+        size_t ind = 0;
+        bool negative = false;
+        if (ind < size && (ptr[ind] == CharT('-') || ptr[ind] == CharT('+')))
+            negative = ptr[ind++] == CharT('-');
+
+        double value = 0;
+        for (; ind < size && isDigit(ptr[ind]); ++ind)
+            value = 10 * value + (ptr[ind] - CharT('0'));
+
+        if (ind < size && ptr[ind] == CharT('.'))
+        {
+            double scale = 1;
+            for (++ind; ind < size && isDigit(ptr[ind]); ++ind)
+            {
+                scale /= 10;
+                value += scale * (ptr[ind] - CharT('0'));
+            }
+        }
+
+        return negative ? -value : value;
+    }
+
+    /*!
+     * Key field of line as a line
+     */
+    String getField(size_t line, size_t key) const
+    {
+        const uint32_t* span = &spans_[2 * (line * keys_.size() + key)];
+        return String(lines_[line].getPtr() + span[0], span[1], lines_[line].hasSurrogates());
+    }
+
+public:
+    BasicFieldTable():
+        keys_(),
+        lines_(),
+        spans_(),
+        values_()
+    {}
+
+    /*!
+     * Locates key fields of all lines
+     * @param text Text in original order
+     * @param keys Keys in order of priority
+     */
+    void build(const BasicText<CharT>& text, const std::vector<FieldKey>& keys)
+    {
+        size_t nLines = text.getNLines();
+        size_t nKeys  = keys.size();
+        keys_ = keys;
+        lines_.resize(nLines);
+        for (size_t i = 0; i < nLines; ++i)
+            lines_[i] = text[i];
+
+        spans_.assign(2 * nLines * nKeys, 0);
+        values_.assign(nLines * nKeys, 0);
+
+        size_t maxField = 0;
+        for (const FieldKey& key : keys_)
+            maxField = std::max(maxField, key.field);
+
+        std::vector<uint32_t> fields(2 * maxField);
+        for (size_t i = 0; i < nLines; ++i)
+        {
+            const CharT* ptr = lines_[i].getPtr();
+            size_t size = lines_[i].getSize();
+            ASSERT(size < UINT32_MAX, "Line is too long for field table");
+
+            size_t nFields = 0;
+            for (size_t ind = 0; ind < size && nFields < maxField; ++nFields)
+            {
+                while (ind < size && isBlank(ptr[ind]))
+                    ++ind;
+
+                size_t start = ind;
+                while (ind < size && !isBlank(ptr[ind]))
+                    ++ind;
+
+                fields[2 * nFields]     = start;
+                fields[2 * nFields + 1] = ind - start;
+            }
+
+            for (size_t k = 0; k < nKeys; ++k)
+            {
+                size_t field = keys_[k].field - 1;
+                uint32_t* span = &spans_[2 * (i * nKeys + k)];
+                span[0] = (field < nFields) ? fields[2 * field]     : size;
+                span[1] = (field < nFields) ? fields[2 * field + 1] : 0;
+
+                if (keys_[k].numeric)
+                    values_[i * nKeys + k] = parseNumber(ptr + span[0], span[1]);
+            }
+        }
+    }
+
+    size_t getNLines() const { return lines_.size(); }
+
+    /*!
+     * Whether build() was called
+     */
+    bool isBuilt() const { return !keys_.empty(); }
+
+    /*!
+     * Compares lines by keys one after another
+     * @param lhs, rhs Indices of lines in original order
+     * @param reversed Whether text fields are compared by their endings
+     * @return Negative, 0 or positive as lhs is less, equal or greater
+     */
+    int compare(size_t lhs, size_t rhs, bool reversed = false) const
+    {
+        for (size_t k = 0; k < keys_.size(); ++k)
+        {
+            int result = 0;
+
+            if (keys_[k].numeric)
+            {
+                double lhsValue = values_[lhs * keys_.size() + k];
+                double rhsValue = values_[rhs * keys_.size() + k];
+                result = (lhsValue < rhsValue) ? -1 : (rhsValue < lhsValue);
+            }
+            else
+            {
+                String lhsField = getField(lhs, k), rhsField = getField(rhs, k);
+                if (reversed ? lhsField.compareReversed(rhsField) : lhsField < rhsField)
+                    result = -1;
+                else if (reversed ? rhsField.compareReversed(lhsField) : rhsField < lhsField)
+                    result = 1;
+            }
+
+            if (result != 0)
+                return keys_[k].descending ? -result : result;
+        }
+
+        return 0;
+    }
+
+    /*!
+     * Field of key for line as offset in line and length
+     * @param line Index of line in original order
+     * @param key Index of key
+     */
+    std::pair<size_t, size_t> getSpan(size_t line, size_t key) const
+    {
+        ASSERT(line < lines_.size() && key < keys_.size(), "Out of field table range");
+        const uint32_t* span = &spans_[2 * (line * keys_.size() + key)];
+        return std::make_pair(span[0], span[1]);
+    }
+};
+
+/*!
+ * Sorts text by fields located in advance, lines with equal keys keep original order
+ * @param text Text to sort
+ * @param table Table built for original order of text, may serve any number of sorts
+ * @param reversed Whether text fields are compared by their endings
+ * @param k Number of first lines to sort, the rest are left in unspecified order
+ */
+template <typename CharT>
+void sortByFields(BasicText<CharT>& text, const BasicFieldTable<CharT>& table, bool reversed = false,
+                  size_t k = SIZE_MAX)
+{
+    ASSERT(table.getNLines() == text.getNLines(), "Field table was built for other text");
+
+    std::vector<uint32_t> order(text.getNLines());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    BasicText<CharT>::sortFirst(order.begin(), order.end(), k, [&table, reversed](uint32_t lhs, uint32_t rhs)
+    {
+        int result = table.compare(lhs, rhs, reversed);
+        return result != 0 ? result < 0 : lhs < rhs;
+    });
+
+    text.setPermutation(order.data());
+}
+
+/*!
+ * Same as above for a single sort, fields are located right here
+ * @param text Text to sort, its original order is taken as a start
+ * @param keys Keys in order of priority
+ * @param reversed Whether text fields are compared by their endings
+ */
+template <typename CharT>
+void sortByFields(BasicText<CharT>& text, const std::vector<FieldKey>& keys, bool reversed = false)
+{
+    text.recoverOriginal();
+
+    BasicFieldTable<CharT> table;
+    table.build(text, keys);
+    sortByFields(text, table, reversed);
+}
+
+typedef BasicFieldTable<char16_t> FieldTable;     //!< Field table of UTF-16 text
+typedef BasicFieldTable<char>     Utf8FieldTable; //!< Field table of UTF-8 text
+
+#endif /* FIELD_KEYS_H_INCLUDED */
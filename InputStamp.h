@@ -0,0 +1,68 @@
+/*!
+ * \file
+ * \brief
+ * \details Stamp of an input file which index files are checked against before reuse
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef INPUT_STAMP_H_INCLUDED
+#define INPUT_STAMP_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * FNV-1a hash of bytes
+ * @param data, size Bytes to hash
+ * @return 64-bit hash
+ */
+inline uint64_t fnv1aHash(const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief What input the index was built for
+ */
+struct InputStamp
+{
+    uint64_t size;  //!< Input file size in bytes
+    int64_t mtime;  //!< Modification time of input file in nanoseconds
+    uint64_t hash;  //!< Hash of read buffer
+
+    /*!
+     * Stamp of file read in text <br>
+     * Buffer is hashed as it is now, so stamps are comparable only when taken <br>
+     * at the same stage of loading, e.g. both right after readRawFromFile
+     * @param filename Path to input file
+     * @param text Text with the file read
+     */
+    template <typename CharT>
+    static InputStamp make(const char* filename, const BasicText<CharT>& text)
+    {
+        struct stat st = {};
+        stat(filename, &st);
+
+        InputStamp stamp = {};
+        stamp.size  = st.st_size;
+        stamp.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        stamp.hash  = fnv1aHash(text.getBuffer(), text.getNSymbols() * sizeof(CharT));
+        return stamp;
+    }
+
+    bool operator ==(const InputStamp& that) const
+    {
+        return size == that.size && mtime == that.mtime && hash == that.hash;
+    }
+};
+
+#endif /* INPUT_STAMP_H_INCLUDED */
@@ -0,0 +1,257 @@
+/*!
+ * \file
+ * \brief
+ * \details Key-pointer sort: normalized keys of lines are copied to one arena and sorted as short records
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef KEY_POINTER_SORT_H_INCLUDED
+#define KEY_POINTER_SORT_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * \brief Sorts lines by normalized keys kept in one contiguous arena
+ *
+ * Every line gets an arena entry: its index, normalized key and a copy of the line. <br>
+ * Sorting moves only records of the first 8 key bytes and the entry offset, so most <br>
+ * comparisons touch no memory but the records. After sorting the arena may be rebuilt <br>
+ * in sorted order, then printing sorted lines is a sequential scan of the arena <br>
+ * Order is stable: equal keys keep order of lines in text
+ * @tparam CharT Code unit of text
+ * @see BasicIntegratedString::appendNormalizedKey
+ */
+template <typename CharT>
+class BasicKeyPointerSorter
+{
+private:
+    /*!
+     * Beginning of every arena entry, followed by key bytes and line units
+     */
+    struct EntryHeader
+    {
+        uint32_t line;     //!< Index of line in text
+        uint32_t keySize;  //!< Number of key bytes
+        uint32_t lineSize; //!< Number of line units
+    };
+
+    /*!
+     * What is sorted
+     */
+    struct Record
+    {
+        uint64_t prefix; //!< First 8 key bytes as big-endian number
+        size_t offset;   //!< Position of entry in arena
+    };
+
+    static const size_t ALIGNMENT_ = alignof(EntryHeader); //!< Every entry starts at multiple of it
+
+    std::vector<unsigned char> arena_; //!< Entries of all lines
+    std::vector<Record> records_;      //!< Entries in sorted order after sort()
+    bool isReordered_;                 //!< Whether arena entries go in sorted order
+
+    EntryHeader getHeader(size_t offset) const
+    {
+        EntryHeader header = {};
+        memcpy(&header, arena_.data() + offset, sizeof(header));
+        return header;
+    }
+
+    const unsigned char* getKey(size_t offset) const
+    {
+        return arena_.data() + offset + sizeof(EntryHeader);
+    }
+
+    static size_t getLineStart(const EntryHeader& header)
+    {
+        return alignUp(sizeof(EntryHeader) + header.keySize, alignof(CharT));
+    }
+
+    static size_t getEntrySize(const EntryHeader& header)
+    {
+        return alignUp(getLineStart(header) + header.lineSize * sizeof(CharT), ALIGNMENT_);
+    }
+
+    static size_t alignUp(size_t size, size_t alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    /*!
+     * Appends entry of line to arena
+     * @return Record of the entry
+     */
+    Record appendEntry(uint32_t index, const BasicIntegratedString<CharT>& line, bool reversed)
+    {
+        size_t offset = arena_.size();
+        arena_.resize(offset + sizeof(EntryHeader));
+        line.appendNormalizedKey(reversed, &arena_);
+
+        EntryHeader header = {index, (uint32_t) (arena_.size() - offset - sizeof(EntryHeader)),
+                              (uint32_t) line.getSize()};
+        memcpy(arena_.data() + offset, &header, sizeof(header));
+
+        arena_.resize(offset + getEntrySize(header));
+        memcpy(arena_.data() + offset + getLineStart(header), line.getPtr(), line.getSize() * sizeof(CharT));
+
+        Record record = {0, offset};
+        const unsigned char* key = getKey(offset);
+        for (size_t i = 0; i < sizeof(record.prefix); ++i)
+            record.prefix = (record.prefix << 8) | (i < header.keySize ? key[i] : 0);
+
+        return record;
+    }
+
+    /*!
+     * Whole keys comparison for records with equal prefixes, entry offset breaks ties
+     */
+    bool isLessEntry(const Record& lhs, const Record& rhs) const
+    {
+        EntryHeader lhsHeader = getHeader(lhs.offset), rhsHeader = getHeader(rhs.offset);
+
+        int result = memcmp(getKey(lhs.offset), getKey(rhs.offset), std::min(lhsHeader.keySize, rhsHeader.keySize));
+        if (result != 0)
+            return result < 0;
+        if (lhsHeader.keySize != rhsHeader.keySize)
+            return lhsHeader.keySize < rhsHeader.keySize;
+
+        return lhs.offset < rhs.offset;
+    }
+
+    BasicKeyPointerSorter(const BasicKeyPointerSorter& that)                   = delete;
+    const BasicKeyPointerSorter& operator =(const BasicKeyPointerSorter& that) = delete;
+
+public:
+    BasicKeyPointerSorter():
+        isReordered_(false)
+    {}
+
+    /*!
+     * Builds arena for lines of text in current order and sorts them
+     * @param text Text to sort
+     * @param reversed Whether to sort by line endings
+     * @param k Number of first records to sort, the rest are left in unspecified order
+     */
+    void sort(const BasicText<CharT>& text, bool reversed = false, size_t k = SIZE_MAX)
+    {
+        arena_.clear();
+        arena_.reserve(text.getNSymbols() * (sizeof(CharT) + 3) + text.getNLines() * 2 * sizeof(EntryHeader));
+        records_.resize(text.getNLines());
+        isReordered_ = false;
+
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            records_[i] = appendEntry(i, text[i], reversed);
+
+        BasicText<CharT>::sortFirst(records_.begin(), records_.end(), k, [this](const Record& lhs, const Record& rhs)
+        {
+            if (lhs.prefix != rhs.prefix)
+                return lhs.prefix < rhs.prefix;
+            return isLessEntry(lhs, rhs);
+        });
+    }
+
+    /*!
+     * Rebuilds arena in sorted order, so entries are visited sequentially from now on
+     */
+    void reorder()
+    {
+        std::vector<unsigned char> sorted;
+        sorted.reserve(arena_.size());
+
+        for (Record& record : records_)
+        {
+            size_t entrySize = getEntrySize(getHeader(record.offset));
+            sorted.insert(sorted.end(), arena_.begin() + record.offset, arena_.begin() + record.offset + entrySize);
+            record.offset = sorted.size() - entrySize;
+        }
+
+        arena_.swap(sorted);
+        isReordered_ = true;
+    }
+
+    bool isReordered() const { return isReordered_; }
+
+    size_t size() const { return records_.size(); }
+
+    /*!
+     * Writes sorted order as indices of lines in order text had when sorted
+     * @param order Array of size() elements, e.g. for BasicText::setPermutation
+     */
+    void getOrder(uint32_t* order) const
+    {
+        for (size_t i = 0; i < records_.size(); ++i)
+            order[i] = getHeader(records_[i].offset).line;
+    }
+
+    /*!
+     * Copy of i-th line in sorted order kept in arena
+     */
+    BasicIntegratedString<CharT> getLine(size_t index) const
+    {
+        ASSERT(index < records_.size(), "Out of sorted lines range");
+
+        EntryHeader header = getHeader(records_[index].offset);
+        return BasicIntegratedString<CharT>((const CharT*) (arena_.data() + records_[index].offset + getLineStart(header)),
+                                            header.lineSize);
+    }
+
+    /*!
+     * Prints sorted lines from arena the same way BasicText::printToFile prints sorted text
+     * @param output File to print in
+     * @param text Text the lines were taken from, gives header and output encoding
+     * @param maxLines Number of first lines to print, all by default
+     */
+    void printToFile(FILE* output, const BasicText<CharT>& text, size_t maxLines = SIZE_MAX) const
+    {
+        ASSERT(output, "Invalid output file");
+
+        std::string encoded;
+        if (text.isTranscodingOutput())
+            text.appendEncodedHeader(&encoded);
+        else
+            fwrite(text.getBuffer(), sizeof(CharT), text.getNHeader(), output);
+
+        const CharT newline = CharT('\n');
+        for (size_t i = 0; i < std::min(records_.size(), maxLines); ++i)
+        {
+            BasicIntegratedString<CharT> line = getLine(i);
+
+            if (text.isTranscodingOutput())
+            {
+                text.appendEncoded(line.getPtr(), line.getSize(), &encoded);
+                text.appendEncoded(&newline, 1, &encoded);
+                continue;
+            }
+
+            fwrite(line.getPtr(), sizeof(CharT), line.getSize(), output);
+            fwrite(&newline, sizeof(CharT), 1, output);
+        }
+
+        fwrite(encoded.data(), 1, encoded.size(), output);
+    }
+};
+
+/*!
+ * Sorts text by key-pointer sort, result is the same as of BasicText::stableSort
+ * @param text Text to sort, its original order is taken as a start
+ * @param reversed Whether to sort by line endings
+ * @param k Number of first lines to sort, the rest are left in unspecified order
+ */
+template <typename CharT>
+void sortByKeyPointers(BasicText<CharT>& text, bool reversed = false, size_t k = SIZE_MAX)
+{
+    text.recoverOriginal();
+
+    BasicKeyPointerSorter<CharT> sorter;
+    sorter.sort(text, reversed, k);
+
+    std::vector<uint32_t> order(sorter.size());
+    sorter.getOrder(order.data());
+    text.setPermutation(order.data());
+}
+
+typedef BasicKeyPointerSorter<char16_t> KeyPointerSorter;     //!< Key-pointer sort of UTF-16 text
+typedef BasicKeyPointerSorter<char>     Utf8KeyPointerSorter; //!< Key-pointer sort of UTF-8 text
+
+#endif /* KEY_POINTER_SORT_H_INCLUDED */
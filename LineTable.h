@@ -0,0 +1,231 @@
+/*!
+ * \file
+ * \brief
+ * \details Lines kept as separate arrays of offsets, lengths and prefix keys, with a sort engine working on them
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef LINE_TABLE_H_INCLUDED
+#define LINE_TABLE_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * \brief Struct-of-arrays form of lines of a text
+ *
+ * Offsets and lengths stay in original order, sorting moves only 64-bit prefix keys <br>
+ * and original indices. Keys are sorted by LSD radix passes which scan both arrays <br>
+ * sequentially, lines themselves are looked at only inside groups of equal keys. <br>
+ * Sorting is stable <br>
+ * Table refers to buffer of text, so text must outlive it
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicLineTable
+{
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of lines
+
+private:
+    static const uint32_t SURROGATES_BIT_ = 1u << 31; //!< Bit of length for lines with surrogate pairs
+    static const unsigned RADIX_BITS_     = 8;        //!< Bits of key sorted by one pass
+
+    const CharT* buffer_;            //!< Buffer of text
+    std::vector<uint32_t> offsets_;  //!< First symbol of every line in buffer, original order
+    std::vector<uint32_t> lengths_;  //!< Number of symbols and SURROGATES_BIT_, original order
+    std::vector<uint64_t> prefixes_; //!< Prefix key of every line, current order
+    std::vector<uint32_t> order_;    //!< Original index of every line, current order
+    bool hasSurrogates_;             //!< Whether some line has surrogate pairs
+
+    /*!
+     * Line of original order
+     */
+    String getLine(uint32_t index) const
+    {
+        return String(buffer_ + offsets_[index], lengths_[index] & ~SURROGATES_BIT_,
+                      lengths_[index] & SURROGATES_BIT_);
+    }
+
+    /*!
+     * Stable LSD radix sort of prefix keys, original indices are moved along <br>
+     * Passes where all keys have the same digit are skipped
+     */
+    void radixSort()
+    {
+        size_t size = prefixes_.size();
+        std::vector<uint64_t> prefixes(size);
+        std::vector<uint32_t> order(size);
+        std::vector<size_t> counts(1 << RADIX_BITS_);
+
+        for (unsigned shift = 0; shift < 64; shift += RADIX_BITS_)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            for (uint64_t prefix : prefixes_)
+                ++counts[(prefix >> shift) & (counts.size() - 1)];
+
+            if (counts[(prefixes_[0] >> shift) & (counts.size() - 1)] == size)
+                continue;
+
+            size_t sum = 0;
+            for (size_t& count : counts)
+            {
+                sum += count;
+                count = sum - count;
+            }
+
+            for (size_t i = 0; i < size; ++i)
+            {
+                size_t place = counts[(prefixes_[i] >> shift) & (counts.size() - 1)]++;
+                prefixes[place] = prefixes_[i];
+                order[place] = order_[i];
+            }
+
+            prefixes_.swap(prefixes);
+            order_.swap(order);
+        }
+    }
+
+public:
+    BasicLineTable():
+        buffer_(nullptr),
+        hasSurrogates_(false)
+    {}
+
+    /*!
+     * Takes lines of text
+     * @param text Text in original order
+     * @param reversed Whether prefix keys are taken from line endings
+     */
+    void build(const BasicText<CharT>& text, bool reversed = false)
+    {
+        ASSERT(text.getNSymbols() < UINT32_MAX, "Text is too large for line table");
+
+        size_t size = text.getNLines();
+        buffer_ = text.getBuffer();
+        offsets_.resize(size);
+        lengths_.resize(size);
+        prefixes_.resize(size);
+        order_.resize(size);
+        hasSurrogates_ = false;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            const String& line = text[i];
+            offsets_[i]  = line.getPtr() - buffer_;
+            lengths_[i]  = line.getSize() | (line.hasSurrogates() ? SURROGATES_BIT_ : 0);
+            prefixes_[i] = line.getPrefixKey(reversed);
+            order_[i]    = i;
+            hasSurrogates_ |= line.hasSurrogates();
+        }
+    }
+
+    /*!
+     * Stable sort by forward or backward comparator of lines
+     * @param reversed Whether to sort by line endings, must be the same as in build()
+     * @param k Number of first lines to sort: after radix passes only groups of equal <br>
+     *          keys starting before k are sorted, the rest are left in unspecified order
+     */
+    void sort(bool reversed = false, size_t k = SIZE_MAX)
+    {
+        auto compareLines = [this, reversed](uint32_t lhs, uint32_t rhs)
+        {
+            return reversed ? getLine(lhs).compareReversed(getLine(rhs)) : getLine(lhs) < getLine(rhs);
+        };
+
+        if (order_.empty())
+            return;
+
+        if (hasSurrogates_)
+        {
+            // Keys of lines with surrogates do not follow code point order
+            std::vector<uint64_t> keys(prefixes_);
+            auto isLess = [&](uint32_t lhs, uint32_t rhs)
+            {
+                if (keys[lhs] != keys[rhs] && !(lengths_[lhs] & SURROGATES_BIT_) && !(lengths_[rhs] & SURROGATES_BIT_))
+                    return keys[lhs] < keys[rhs];
+                return compareLines(lhs, rhs);
+            };
+
+            // Original index breaks ties, so only k first lines are sorted and order stays stable
+            BasicText<CharT>::sortFirst(order_.begin(), order_.end(), k, [&isLess](uint32_t lhs, uint32_t rhs)
+            {
+                if (isLess(lhs, rhs))
+                    return true;
+                return !isLess(rhs, lhs) && lhs < rhs;
+            });
+
+            for (size_t i = 0; i < order_.size(); ++i)
+                prefixes_[i] = keys[order_[i]];
+            return;
+        }
+
+        radixSort();
+
+        for (size_t first = 0, last = 0; first < std::min(order_.size(), k); first = last)
+        {
+            while (last < order_.size() && prefixes_[last] == prefixes_[first])
+                ++last;
+
+            if (last - first > 1)
+                std::stable_sort(order_.begin() + first, order_.begin() + last, compareLines);
+        }
+    }
+
+    size_t size() const { return order_.size(); }
+
+    /*!
+     * Original index of i-th line in current order
+     */
+    const uint32_t* getOrder() const { return order_.data(); }
+
+    /*!
+     * Prefix key of i-th line in current order
+     */
+    uint64_t getPrefix(size_t index) const
+    {
+        ASSERT(index < prefixes_.size(), "Out of line table range");
+        return prefixes_[index];
+    }
+
+    /*!
+     * Offset in buffer of i-th line in current order
+     */
+    size_t getOffset(size_t index) const
+    {
+        ASSERT(index < order_.size(), "Out of line table range");
+        return offsets_[order_[index]];
+    }
+
+    /*!
+     * Number of symbols of i-th line in current order
+     */
+    size_t getLength(size_t index) const
+    {
+        ASSERT(index < order_.size(), "Out of line table range");
+        return lengths_[order_[index]] & ~SURROGATES_BIT_;
+    }
+};
+
+/*!
+ * Sorts text with line table, result is the same as of BasicText::stableSort
+ * @param text Text to sort, its original order is taken as a start
+ * @param reversed Whether to sort by line endings
+ * @param k Number of first lines to sort, the rest are left in unspecified order
+ */
+template <typename CharT>
+void sortByLineTable(BasicText<CharT>& text, bool reversed = false, size_t k = SIZE_MAX)
+{
+    text.recoverOriginal();
+
+    BasicLineTable<CharT> table;
+    table.build(text, reversed);
+    table.sort(reversed, k);
+
+    text.setPermutation(table.getOrder());
+}
+
+typedef BasicLineTable<char16_t> LineTable;     //!< Line table of UTF-16 text
+typedef BasicLineTable<char>     Utf8LineTable; //!< Line table of UTF-8 text
+
+#endif /* LINE_TABLE_H_INCLUDED */
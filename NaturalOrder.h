@@ -0,0 +1,141 @@
+/*!
+ * \file
+ * \brief
+ * \details Natural order of lines: runs of digits are compared as numbers, so "Глава 2" goes before "Глава 10"
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef NATURAL_ORDER_H_INCLUDED
+#define NATURAL_ORDER_H_INCLUDED
+
+#include "Text.h"
+
+const unsigned char NATURAL_NUMBER_MARK = '0'; //!< Byte starting a number in natural key
+
+/*!
+ * Appends natural key of line: bytes which compare by memcmp in natural order <br>
+ * Line is taken as appendNormalizedKey gives it, every run of digits is replaced by <br>
+ * NATURAL_NUMBER_MARK, 32-bit big-endian number of significant digits and the digits. <br>
+ * Digits never appear in key outside of numbers, so a longer number is greater, <br>
+ * numbers of the same length are compared digit by digit, leading zeros are ignored
+ * @param line Line to build key for
+ * @param reversed Whether key is for backward order: symbols are taken from the end, <br>
+ *                 numbers are still read as they are written
+ * @param key Place to append bytes
+ */
+template <typename CharT>
+void appendNaturalKey(const BasicIntegratedString<CharT>& line, bool reversed, std::vector<unsigned char>* key)
+{
+    static thread_local std::vector<unsigned char> symbols;
+    symbols.clear();
+    line.appendNormalizedKey(false, &symbols);
+
+    auto isDigit = [](unsigned char byte) { return byte >= '0' && byte <= '9'; };
+
+    // Runs of digits are found in forward order, reversed key takes them from the last one
+    size_t size = symbols.size();
+    for (size_t done = 0; done < size; )
+    {
+        size_t end   = reversed ? size - done : done;
+        size_t begin = end;
+
+        if (reversed ? isDigit(symbols[end - 1]) : isDigit(symbols[end]))
+        {
+            if (reversed)
+                while (begin > 0 && isDigit(symbols[begin - 1]))
+                    --begin;
+            else
+                while (end < size && isDigit(symbols[end]))
+                    ++end;
+
+            size_t first = begin;
+            while (first < end && symbols[first] == '0')
+                ++first;
+
+            uint32_t nDigits = end - first;
+            unsigned char header[] = {NATURAL_NUMBER_MARK, (unsigned char) (nDigits >> 24), (unsigned char) (nDigits >> 16),
+                                      (unsigned char) (nDigits >> 8), (unsigned char) nDigits};
+            key->insert(key->end(), header, header + sizeof(header));
+            key->insert(key->end(), symbols.begin() + first, symbols.begin() + end);
+        }
+        else if (reversed)
+        {
+            // Symbol before end: one encoded code point
+            --begin;
+            while (begin > 0 && utf8_is_continuation(symbols[begin]))
+                --begin;
+            key->insert(key->end(), symbols.begin() + begin, symbols.begin() + end);
+        }
+        else
+        {
+            key->push_back(symbols[end++]);
+        }
+
+        done += end - begin;
+    }
+}
+
+/*!
+ * \brief Comparator of lines in natural order, to pass to BasicText::sortByIndices
+ *
+ * Digit runs of all lines are parsed once, when comparator is made: natural keys <br>
+ * are kept in an arena indexed by original line, so comparison is one memcmp <br>
+ * Keys refer to nothing in text, but they are valid only while text has the same lines
+ * @tparam CharT Code unit of text
+ * @see appendNaturalKey
+ */
+template <typename CharT>
+class BasicNaturalComparator
+{
+private:
+    SortKeyArena keys_; //!< Natural key of every line of original order
+
+public:
+    /*!
+     * Builds keys of all lines
+     * @param text Text in any order
+     * @param reversed Whether lines are compared by their endings like reverseStringComparator
+     */
+    BasicNaturalComparator(const BasicText<CharT>& text, bool reversed):
+        keys_()
+    {
+        size_t nLines = text.getNLines();
+        std::vector<uint32_t> order(nLines), current(nLines);
+        text.getPermutation(order.data());
+        for (size_t i = 0; i < nLines; ++i)
+            current[order[i]] = i;
+
+        keys_.reserve(nLines, 2 * text.getNSymbols() * sizeof(CharT));
+        for (size_t i = 0; i < nLines; ++i)
+        {
+            appendNaturalKey(text[current[i]], reversed, keys_.getBytes());
+            keys_.closeKey();
+        }
+    }
+
+    /*!
+     * Compares lines by their indices in original order
+     */
+    bool operator ()(size_t lhs, size_t rhs) const
+    {
+        return keys_.compare(lhs, rhs) < 0;
+    }
+};
+
+typedef BasicNaturalComparator<char16_t> NaturalComparator;     //!< Natural comparator of UTF-16 text
+typedef BasicNaturalComparator<char>     Utf8NaturalComparator; //!< Natural comparator of UTF-8 text
+
+/*!
+ * Sorts text in natural order, lines with equal keys keep original order
+ * @param text Text to sort
+ * @param reversed Whether to sort by line endings like reverseStringComparator
+ * @param k Number of first lines to sort
+ */
+template <typename CharT>
+void sortNatural(BasicText<CharT>& text, bool reversed, size_t k = SIZE_MAX)
+{
+    text.sortByIndices(BasicNaturalComparator<CharT>(text, reversed), k);
+}
+
+#endif /* NATURAL_ORDER_H_INCLUDED */
@@ -0,0 +1,340 @@
+/*!
+ * \file
+ * \brief
+ * \details Staged sorting of many files: reading, sorting and writing of different files overlap
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include "Batch.h"
+
+/*!
+ * \brief Bounded lock-free queue for one producer and one consumer
+ *
+ * Ring buffer with two monotonic counters, no locks and no allocation <br>
+ * Blocking operations spin yielding processor to other threads
+ * @tparam T Trivially copyable element type
+ * @tparam CAPACITY Maximal number of elements inside
+ */
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+private:
+    T items_[CAPACITY]; //!< Ring of elements
+
+    alignas(64) std::atomic<size_t> head_; //!< Number of elements ever popped
+    alignas(64) std::atomic<size_t> tail_; //!< Number of elements ever pushed
+
+public:
+    SpscQueue():
+        items_(),
+        head_(0),
+        tail_(0)
+    {}
+
+    /*!
+     * Pushes element if there is space
+     * @return false if queue is full
+     */
+    bool tryPush(const T& item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+
+        items_[tail % CAPACITY] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * Pops element if there is one
+     * @param item Place to write popped element
+     * @return false if queue is empty
+     */
+    bool tryPop(T* item)
+    {
+        assert(item);
+
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+
+        *item = items_[head % CAPACITY];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * Pushes element waiting for space
+     */
+    void push(const T& item)
+    {
+        while (!tryPush(item))
+            std::this_thread::yield();
+    }
+
+    /*!
+     * Pops element waiting for it
+     */
+    T pop()
+    {
+        T item;
+        while (!tryPop(&item))
+            std::this_thread::yield();
+
+        return item;
+    }
+};
+
+/*!
+ * \brief Sorts a list of files in three overlapping stages
+ *
+ * Reader thread loads file N+1 while sorter thread splits and sorts file N <br>
+ * and calling thread writes file N-1. Stages pass a fixed set of Text objects <br>
+ * through lock-free queues and return them for reuse after writing <br>
+ * Every output is exactly the same as produced by a separate run
+ * @tparam CharT Code unit of texts
+ */
+template <typename CharT>
+class BasicPipelineSorter
+{
+private:
+    typedef BasicText<CharT> TextT;
+
+    /*!
+     * One file travelling through the stages
+     */
+    struct Job
+    {
+        TextT text;                                //!< Reused text object
+        size_t file;                               //!< Index in file list
+        bool isRead;                               //!< Whether reading succeeded
+        std::vector<typename TextT::Order> orders; //!< Sorted versions to print
+    };
+
+    static const size_t DEPTH_ = 4; //!< Number of files in flight
+
+    typedef SpscQueue<Job*, DEPTH_> JobQueue;
+
+    const FileList* files_; //!< Files being sorted by run()
+    Job jobs_[DEPTH_];      //!< Storage of all files in flight
+
+    JobQueue free_;   //!< Written jobs returning to reader
+    JobQueue loaded_; //!< Read jobs waiting for sort
+    JobQueue sorted_; //!< Sorted jobs waiting for write
+
+    PrintOptions options_; //!< Versions to print for each file
+    bool asyncIO_;  //!< Whether to write with io_uring
+    size_t nWritten_; //!< Number of files written by run()
+
+    /*!
+     * Writes remembered orders with one batch of asynchronous writes
+     * @return Whether the file is written
+     */
+    bool writeJobAsync(Job* job)
+    {
+        OutputBatch batch;
+
+        for (const typename TextT::Order& order : job->orders)
+        {
+            job->text.setOrder(order);
+            job->text.collectOutput(&batch, options_.getSortedLimit());
+        }
+
+        if (options_.needOrig)
+        {
+            job->text.recoverOriginal();
+            job->text.collectOutput(&batch);
+        }
+
+        if (batch.write(files_->getOutput(job->file), threadIoRing()))
+            return true;
+
+        fprintf(stderr, "Unable to write file %s\n", files_->getOutput(job->file));
+        return false;
+    }
+
+    /*!
+     * First stage: reads files into free texts
+     */
+    void readStage()
+    {
+        for (size_t i = 0; i < files_->size(); ++i)
+        {
+            Job* job = free_.pop();
+            job->file = i;
+            job->isRead = job->text.readRawFromFile(files_->getInput(i));
+
+            if (!job->isRead)
+                fprintf(stderr, "Unable to read file: %s\n", files_->getInput(i));
+
+            loaded_.push(job);
+        }
+
+        loaded_.push(nullptr);
+    }
+
+    /*!
+     * Second stage: splits texts into lines and remembers asked orders
+     */
+    void sortStage()
+    {
+        while (Job* job = loaded_.pop())
+        {
+            job->orders.clear();
+
+            if (job->isRead)
+            {
+                job->text.splitLines();
+
+                if (options_.unique)
+                    job->text.removeDuplicates();
+
+                BasicFieldTable<CharT> fields;
+                if (options_.needSort)
+                {
+                    sortDirection(job->text, false, options_, &fields);
+                    job->orders.push_back(job->text.getOrder());
+                }
+
+                if (options_.needRev)
+                {
+                    sortDirection(job->text, true, options_, &fields);
+                    job->orders.push_back(job->text.getOrder());
+                }
+            }
+
+            sorted_.push(job);
+        }
+
+        sorted_.push(nullptr);
+    }
+
+    /*!
+     * Last stage: prints remembered orders and gives text back to reader
+     */
+    void writeStage()
+    {
+        while (Job* job = sorted_.pop())
+        {
+            if (asyncIO_ && job->isRead)
+            {
+                if (writeJobAsync(job))
+                    ++nWritten_;
+                free_.push(job);
+                continue;
+            }
+
+            FILE* output = job->isRead ? fopen(files_->getOutput(job->file), "wb") : nullptr;
+
+            if (output)
+            {
+                for (const typename TextT::Order& order : job->orders)
+                {
+                    job->text.setOrder(order);
+                    job->text.printToFile(output, options_.getSortedLimit());
+                }
+
+                if (options_.needOrig)
+                {
+                    job->text.recoverOriginal();
+                    job->text.printToFile(output);
+                }
+
+                fclose(output);
+                ++nWritten_;
+            }
+            else if (job->isRead)
+                fprintf(stderr, "Unable to open file %s for output\n", files_->getOutput(job->file));
+
+            free_.push(job);
+        }
+    }
+
+    BasicPipelineSorter(const BasicPipelineSorter& that)                   = delete;
+    const BasicPipelineSorter& operator =(const BasicPipelineSorter& that) = delete;
+
+public:
+    BasicPipelineSorter():
+        files_(nullptr),
+        options_(),
+        asyncIO_(false),
+        nWritten_(0)
+    {}
+
+    /*!
+     * Chooses versions to print for each file
+     * @see printFiles
+     */
+    void setPrintOptions(const PrintOptions& options)
+    {
+        options_ = options;
+    }
+
+    /*!
+     * @see Text::useHugePages
+     */
+    void useHugePages(bool enable = true)
+    {
+        for (Job& job : jobs_)
+            job.text.useHugePages(enable);
+    }
+
+    /*!
+     * @see Text::useAsyncIO, writeFilesAsync
+     */
+    void useAsyncIO(bool enable = true)
+    {
+        asyncIO_ = enable;
+        for (Job& job : jobs_)
+            job.text.useAsyncIO(enable);
+    }
+
+    /*!
+     * @see Text::setEncodings
+     */
+    void setEncodings(TextEncoding input, TextEncoding output)
+    {
+        for (Job& job : jobs_)
+            job.text.setEncodings(input, output);
+    }
+
+    /*!
+     * Sorts all files of the list and returns when everything is written
+     * @param files Files to sort
+     * @return Number of files written, skipped inputs are not counted
+     */
+    size_t run(const FileList& files)
+    {
+        files_    = &files;
+        nWritten_ = 0;
+
+        for (Job& job : jobs_)
+            free_.push(&job);
+
+        std::thread reader(&BasicPipelineSorter::readStage, this);
+        std::thread sorter(&BasicPipelineSorter::sortStage, this);
+
+        writeStage();
+
+        reader.join();
+        sorter.join();
+
+        Job* job = nullptr;
+        while (free_.tryPop(&job))
+            ;
+
+        files_ = nullptr;
+        return nWritten_;
+    }
+};
+
+typedef BasicPipelineSorter<char16_t> PipelineSorter;      //!< Pipeline of UTF-16 texts
+typedef BasicPipelineSorter<char>     Utf8PipelineSorter;  //!< Pipeline of UTF-8 texts sorted directly
+typedef BasicPipelineSorter<char32_t> Utf32PipelineSorter; //!< Pipeline of UTF-32 texts
+
+#endif /* PIPELINE_H_INCLUDED */
@@ -0,0 +1,313 @@
+/*!
+ * \file
+ * \brief
+ * \details Index of rhymes: reverse-sorted lines grouped by their last letters
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef RHYME_INDEX_H_INCLUDED
+#define RHYME_INDEX_H_INCLUDED
+
+#include "InputStamp.h"
+
+/*!
+ * \brief Groups lines of text which end with the same letters
+ *
+ * Lines are taken in reverse-sorted order, so lines with a common ending are neighbours. <br>
+ * Every line gets a rhyme key: its last letters, service symbols skipped, from the end. <br>
+ * Lines with equal keys form a cluster, and all lines rhyming with a word are found <br>
+ * by binary search over keys in O(log n) <br>
+ * Index refers to lines of text, so text must outlive it
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicRhymeIndex
+{
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of lines
+    typedef std::pair<size_t, size_t>    Range;  //!< Half-open range of positions in index
+
+    static const size_t DEFAULT_SUFFIX_LENGTH = 2; //!< Number of last letters lines share by default
+
+private:
+    /*!
+     * Header of index file
+     */
+    struct FileHeader
+    {
+        char magic[8];         //!< FILE_MAGIC_
+        uint32_t version;      //!< FILE_VERSION_
+        uint32_t unitSize;     //!< sizeof(CharT) of text
+        uint64_t suffixLength; //!< Number of letters in rhyme
+        InputStamp stamp;      //!< Input the index was built for
+        uint64_t nSymbols;     //!< Size of text the index was built for
+        uint64_t nLines;       //!< Number of lines entries after header
+        uint64_t nClusters;    //!< Number of cluster starts after lines
+    };
+
+    /*!
+     * Line as it is stored in index file
+     */
+    struct FileLine
+    {
+        uint64_t offset; //!< Index of the first symbol in text buffer
+        uint64_t size;   //!< Number of symbols
+    };
+
+    static constexpr const char* FILE_MAGIC_ = "ONEGRHYM";
+    static const uint32_t FILE_VERSION_ = 2;
+
+    size_t suffixLength_;          //!< Number of letters in rhyme key
+    std::vector<String> lines_;    //!< Lines in order of rhyme keys
+    std::vector<size_t> clusters_; //!< Position of the first line of every cluster
+    SortKeyArena keys_;            //!< Rhyme key of every line of lines_
+
+    /*!
+     * Reads the last symbol before end and moves end to its beginning
+     */
+    static uint32_t readLastSymbol(const CharT* ptr, size_t* end)
+    {
+        size_t ind = 0;
+        uint32_t code = CodeUnitTraits<CharT>::readCodePoint(ptr, *end - 1, *end, &ind, -1);
+        *end -= ind;
+        return code;
+    }
+
+    /*!
+     * Appends rhyme key of line and closes it: up to suffixLength_ last letters <br>
+     * from the end, each as 32-bit code point
+     */
+    void appendKey(const String& line, SortKeyArena* keys) const
+    {
+        size_t end = line.getSize();
+
+        for (size_t nLetters = 0; nLetters < suffixLength_ && end > 0; )
+        {
+            uint32_t code = readLastSymbol(line.getPtr(), &end);
+            if (code < 0x80 && String::isProhibitedSymbol(CharT(code)))
+                continue;
+
+            keys->appendCodePoint(code);
+            ++nLetters;
+        }
+
+        keys->closeKey();
+    }
+
+    /*!
+     * Builds keys of lines_ and finds borders of clusters <br>
+     * Lines are brought to order of keys if reverse order of text differs from it
+     */
+    void indexLines()
+    {
+        keys_.clear();
+        for (const String& line : lines_)
+            appendKey(line, &keys_);
+
+        std::vector<size_t> order(lines_.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+
+        auto keyLess = [this](size_t lhs, size_t rhs) { return keys_.compare(lhs, rhs) < 0; };
+        if (!std::is_sorted(order.begin(), order.end(), keyLess))
+        {
+            std::stable_sort(order.begin(), order.end(), keyLess);
+
+            std::vector<String> sorted(lines_.size());
+            for (size_t i = 0; i < order.size(); ++i)
+                sorted[i] = lines_[order[i]];
+
+            lines_.swap(sorted);
+            keys_.clear();
+            for (const String& line : lines_)
+                appendKey(line, &keys_);
+        }
+
+        clusters_.clear();
+        for (size_t i = 0; i < lines_.size(); ++i)
+            if (i == 0 || keys_.compare(i - 1, i) != 0)
+                clusters_.push_back(i);
+    }
+
+public:
+    /*!
+     * @param suffixLength Number of last letters rhyming lines share
+     */
+    explicit BasicRhymeIndex(size_t suffixLength = DEFAULT_SUFFIX_LENGTH):
+        suffixLength_(suffixLength),
+        lines_(),
+        clusters_(),
+        keys_()
+    {}
+
+    /*!
+     * Sorts text in reverse order and builds index from it <br>
+     * Text is left reverse-sorted
+     * @param text Text to index
+     */
+    void build(BasicText<CharT>& text)
+    {
+        text.sort(reverseStringComparator);
+
+        lines_.resize(text.getNLines());
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            lines_[i] = text[i];
+
+        indexLines();
+    }
+
+    size_t getNLines()       const { return lines_.size(); }
+    size_t getNClusters()    const { return clusters_.size(); }
+    size_t getSuffixLength() const { return suffixLength_; }
+
+    /*!
+     * Line at given position of index
+     */
+    const String& operator [](size_t index) const
+    {
+        ASSERT(index < lines_.size(), "Out of rhyme index range");
+        return lines_[index];
+    }
+
+    /*!
+     * Positions of lines of i-th cluster
+     */
+    Range getCluster(size_t index) const
+    {
+        ASSERT(index < clusters_.size(), "Out of rhyme clusters range");
+        size_t end = (index + 1 < clusters_.size()) ? clusters_[index + 1] : lines_.size();
+        return Range(clusters_[index], end);
+    }
+
+    /*!
+     * Finds all lines rhyming with word by binary search
+     * @param word Word or line to find rhymes for
+     * @return Positions of rhyming lines, empty range if there are none
+     */
+    Range findRhymes(const String& word) const
+    {
+        SortKeyArena wordKey;
+        appendKey(word, &wordKey);
+
+        const unsigned char* key = wordKey.getKey(0);
+        size_t size = wordKey.getKeySize(0);
+
+        size_t first = 0, last = lines_.size();
+        while (first < last)
+        {
+            size_t middle = first + (last - first) / 2;
+            if (keys_.compare(middle, key, size) < 0)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+
+        size_t end = first;
+        last = lines_.size();
+        while (end < last)
+        {
+            size_t middle = end + (last - end) / 2;
+            if (keys_.compare(middle, key, size) <= 0)
+                end = middle + 1;
+            else
+                last = middle;
+        }
+
+        return Range(first, end);
+    }
+
+    /*!
+     * Writes index to file, lines are stored as offsets in text buffer
+     * @param filename Path to index file
+     * @param inputFilename Path to file text was loaded from
+     * @param text Text index was built for
+     * @return false if file can not be written
+     */
+    bool save(const char* filename, const char* inputFilename, const BasicText<CharT>& text) const
+    {
+        FILE* output = fopen(filename, "wb");
+        if (!output)
+            return false;
+
+        FileHeader header = {};
+        memcpy(header.magic, FILE_MAGIC_, sizeof(header.magic));
+        header.version      = FILE_VERSION_;
+        header.unitSize     = sizeof(CharT);
+        header.suffixLength = suffixLength_;
+        header.stamp        = InputStamp::make(inputFilename, text);
+        header.nSymbols     = text.getNSymbols();
+        header.nLines       = lines_.size();
+        header.nClusters    = clusters_.size();
+
+        std::vector<FileLine> fileLines(lines_.size());
+        for (size_t i = 0; i < lines_.size(); ++i)
+            fileLines[i] = {(uint64_t) (lines_[i].getPtr() - text.getBuffer()), lines_[i].getSize()};
+
+        std::vector<uint64_t> fileClusters(clusters_.begin(), clusters_.end());
+
+        bool written = fwrite(&header, sizeof(header), 1, output) == 1 &&
+                       fwrite(fileLines.data(), sizeof(FileLine), fileLines.size(), output) == fileLines.size() &&
+                       fwrite(fileClusters.data(), sizeof(uint64_t), fileClusters.size(), output) == fileClusters.size();
+
+        return (fclose(output) == 0) && written;
+    }
+
+    /*!
+     * Reads index written by save() for the same text, no sorting is done
+     * @param filename Path to index file
+     * @param inputFilename Path to file text was loaded from
+     * @param text Text index was built for, already loaded
+     * @return false if file is absent, damaged or was built for other input or suffix length
+     */
+    bool load(const char* filename, const char* inputFilename, const BasicText<CharT>& text)
+    {
+        FILE* input = fopen(filename, "rb");
+        if (!input)
+            return false;
+
+        FileHeader header = {};
+        bool isValid = fread(&header, sizeof(header), 1, input) == 1 &&
+                       memcmp(header.magic, FILE_MAGIC_, sizeof(header.magic)) == 0 &&
+                       header.version == FILE_VERSION_ && header.unitSize == sizeof(CharT) &&
+                       header.suffixLength == suffixLength_ && header.nSymbols == text.getNSymbols() &&
+                       header.nLines == text.getNLines() && header.nClusters <= header.nLines &&
+                       header.stamp == InputStamp::make(inputFilename, text);
+
+        std::vector<FileLine> fileLines(isValid ? header.nLines : 0);
+        std::vector<uint64_t> fileClusters(isValid ? header.nClusters : 0);
+
+        isValid = isValid &&
+                  fread(fileLines.data(), sizeof(FileLine), fileLines.size(), input) == fileLines.size() &&
+                  fread(fileClusters.data(), sizeof(uint64_t), fileClusters.size(), input) == fileClusters.size();
+        fclose(input);
+
+        for (const FileLine& line : fileLines)
+            isValid = isValid && line.offset + line.size <= header.nSymbols;
+
+        // Clusters start at the first line and go strictly inside the lines
+        for (size_t i = 0; i < fileClusters.size(); ++i)
+            isValid = isValid && fileClusters[i] < header.nLines && (i ? fileClusters[i - 1] < fileClusters[i]
+                                                                        : fileClusters[i] == 0);
+        isValid = isValid && (header.nLines == 0 || !fileClusters.empty());
+
+        if (!isValid)
+            return false;
+
+        lines_.resize(fileLines.size());
+        for (size_t i = 0; i < fileLines.size(); ++i)
+            lines_[i] = String(text.getBuffer() + fileLines[i].offset, fileLines[i].size);
+
+        keys_.clear();
+        for (const String& line : lines_)
+            appendKey(line, &keys_);
+
+        clusters_.assign(fileClusters.begin(), fileClusters.end());
+        return true;
+    }
+};
+
+typedef BasicRhymeIndex<char16_t> RhymeIndex;     //!< Rhymes of UTF-16 text
+typedef BasicRhymeIndex<char>     Utf8RhymeIndex; //!< Rhymes of UTF-8 text
+
+#endif /* RHYME_INDEX_H_INCLUDED */
@@ -0,0 +1,128 @@
+/*!
+ * \file
+ * \brief
+ * \details Arena of precomputed sort keys: lines are ordered by plain byte comparison of their keys
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef SORT_KEYS_H_INCLUDED
+#define SORT_KEYS_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+/*!
+ * \brief Byte strings of all keys kept one after another in one array
+ *
+ * Key i is built by appending bytes to getBytes() and calling closeKey() <br>
+ * Keys are compared with memcmp, shorter key is less if it is a prefix of longer one
+ */
+class SortKeyArena
+{
+private:
+    std::vector<unsigned char> bytes_; //!< Bytes of all keys
+    std::vector<size_t> ends_;         //!< Offset after the last byte of every key
+
+public:
+    /*!
+     * Forgets all keys, keeps memory for the next text
+     */
+    void clear()
+    {
+        bytes_.clear();
+        ends_.clear();
+    }
+
+    /*!
+     * Prepares memory for given number of keys and their total size
+     */
+    void reserve(size_t nKeys, size_t nBytes)
+    {
+        ends_.reserve(nKeys);
+        bytes_.reserve(nBytes);
+    }
+
+    /*!
+     * Place to append bytes of the key being built
+     */
+    std::vector<unsigned char>* getBytes()
+    {
+        return &bytes_;
+    }
+
+    /*!
+     * Finishes the key being built, the next bytes go to a new key
+     */
+    void closeKey()
+    {
+        ends_.push_back(bytes_.size());
+    }
+
+    size_t size() const { return ends_.size(); }
+
+    /*!
+     * Pointer to the first byte of i-th key
+     */
+    const unsigned char* getKey(size_t index) const
+    {
+        return bytes_.data() + (index ? ends_[index - 1] : 0);
+    }
+
+    /*!
+     * Number of bytes in i-th key
+     */
+    size_t getKeySize(size_t index) const
+    {
+        return ends_[index] - (index ? ends_[index - 1] : 0);
+    }
+
+    /*!
+     * Compares key with outer byte string
+     * @param index Index of key in arena
+     * @param key, size Bytes to compare with
+     * @return Negative if key of arena is less, 0 if they are equal, positive otherwise
+     */
+    int compare(size_t index, const unsigned char* key, size_t size) const
+    {
+        size_t indexSize = getKeySize(index);
+
+        int result = memcmp(getKey(index), key, std::min(indexSize, size));
+        if (result != 0)
+            return result;
+
+        return (indexSize > size) - (indexSize < size);
+    }
+
+    /*!
+     * Compares two keys byte by byte
+     * @return Negative if key lhs is less, 0 if keys are equal, positive otherwise
+     */
+    int compare(size_t lhs, size_t rhs) const
+    {
+        return compare(lhs, getKey(rhs), getKeySize(rhs));
+    }
+
+    /*!
+     * Appends 16-bit weight in big-endian order, so memcmp compares weights as numbers
+     */
+    void appendWeight(unsigned weight)
+    {
+        bytes_.push_back((unsigned char) (weight >> 8));
+        bytes_.push_back((unsigned char) weight);
+    }
+
+    /*!
+     * Appends 32-bit code point in big-endian order
+     */
+    void appendCodePoint(uint32_t code)
+    {
+        appendWeight(code >> 16);
+        appendWeight(code & 0xffff);
+    }
+};
+
+#endif /* SORT_KEYS_H_INCLUDED */
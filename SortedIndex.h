@@ -0,0 +1,339 @@
+/*!
+ * \file
+ * \brief
+ * \details Index file with sorted orders of a text, lets repeated runs on unchanged input skip sorting
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef SORTED_INDEX_H_INCLUDED
+#define SORTED_INDEX_H_INCLUDED
+
+#include "Batch.h"
+#include "InputStamp.h"
+#include <fcntl.h>
+
+/*!
+ * \brief Read-only mapping of index file with line table and both sorted orders
+ *
+ * File holds header, then four arrays of 32-bit numbers of nLines elements: <br>
+ * offsets and sizes of lines in original order, forward and reverse sorted orders <br>
+ * as indices of original lines. Arrays are used right from the mapping, <br>
+ * so loading costs neither reading nor parsing of the file
+ */
+class SortedIndex
+{
+private:
+    /*!
+     * Header of index file
+     */
+    struct FileHeader
+    {
+        char magic[8];       //!< FILE_MAGIC_
+        uint32_t version;    //!< FILE_VERSION_
+        uint32_t unitSize;   //!< sizeof(CharT) of text
+        uint32_t orderFlags; //!< Options of sorting, see getOrderFlags
+        uint32_t reserved;   //!< Zero
+        InputStamp stamp;    //!< Input the index was built for
+        uint64_t nSymbols;   //!< Size of read buffer in symbols
+        uint64_t nHeader;    //!< Symbols before the first line
+        uint64_t nLines;     //!< Number of elements in every array
+    };
+
+    static constexpr const char* FILE_MAGIC_ = "ONEGSIDX";
+    static const uint32_t FILE_VERSION_ = 2;
+
+    enum Table
+    {
+        TABLE_OFFSETS,
+        TABLE_SIZES,
+        TABLE_FORWARD,
+        TABLE_REVERSE,
+        N_TABLES
+    };
+
+    void* map_;      //!< Mapped file, nullptr if none
+    size_t mapSize_; //!< Size of mapping in bytes
+
+    const FileHeader* getHeader() const
+    {
+        return (const FileHeader*) map_;
+    }
+
+    const uint32_t* getTable(Table table) const
+    {
+        return (const uint32_t*) (getHeader() + 1) + table * getHeader()->nLines;
+    }
+
+    SortedIndex(const SortedIndex& that)                   = delete;
+    const SortedIndex& operator =(const SortedIndex& that) = delete;
+
+public:
+    SortedIndex():
+        map_(nullptr),
+        mapSize_(0)
+    {}
+
+    ~SortedIndex()
+    {
+        close();
+    }
+
+    /*!
+     * Sorting options the stored orders depend on
+     */
+    static uint32_t getOrderFlags(const PrintOptions& options)
+    {
+        bool isStable = options.stable || options.lineTable || options.keySort;
+        uint32_t flags = options.collate | (options.fold << 1) | (options.unique << 3) | (isStable << 4) |
+                         (options.natural << 5);
+
+        // Field keys take the upper bits as a hash of their list
+        if (!options.fieldKeys.empty())
+        {
+            std::vector<uint64_t> keys;
+            for (const FieldKey& key : options.fieldKeys)
+                keys.push_back(key.field << 2 | key.numeric << 1 | key.descending);
+
+            flags |= (uint32_t) (fnv1aHash(keys.data(), keys.size() * sizeof(uint64_t)) | 1) << 8;
+        }
+
+        return flags;
+    }
+
+    /*!
+     * Maps index file to memory
+     * @param filename Path to index file
+     * @return false if file is absent or is not an index
+     */
+    bool open(const char* filename)
+    {
+        close();
+
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st = {};
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(FileHeader))
+        {
+            mapSize_ = st.st_size;
+            map_ = mmap(nullptr, mapSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map_ == MAP_FAILED)
+                map_ = nullptr;
+        }
+
+        ::close(fd);
+
+        if (!map_ || memcmp(getHeader()->magic, FILE_MAGIC_, sizeof(getHeader()->magic)) != 0 ||
+            getHeader()->version != FILE_VERSION_ ||
+            mapSize_ != sizeof(FileHeader) + N_TABLES * getHeader()->nLines * sizeof(uint32_t))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    /*!
+     * Unmaps index file
+     */
+    void close()
+    {
+        if (map_)
+            munmap(map_, mapSize_);
+
+        map_ = nullptr;
+        mapSize_ = 0;
+    }
+
+    /*!
+     * Checks that opened index was built for the same input and sorting
+     * @param stamp Stamp of read input
+     * @param unitSize sizeof(CharT) of text
+     * @param orderFlags Result of getOrderFlags
+     * @param nSymbols Size of read buffer
+     */
+    bool matches(const InputStamp& stamp, size_t unitSize, uint32_t orderFlags, size_t nSymbols) const
+    {
+        return map_ && getHeader()->stamp == stamp && getHeader()->unitSize == unitSize &&
+               getHeader()->orderFlags == orderFlags && getHeader()->nSymbols == nSymbols;
+    }
+
+    /*!
+     * Checks tables of opened index: lines go one after another inside buffer <br>
+     * and both orders hold every line exactly once. File may be damaged, <br>
+     * so nothing of it is used before this check
+     * @param nSymbols Size of read buffer
+     */
+    bool isConsistent(size_t nSymbols) const
+    {
+        size_t nLines = getNLines();
+        if (!map_ || nLines == 0 || getNHeader() > nSymbols)
+            return false;
+
+        const uint32_t* offsets = getOffsets();
+        const uint32_t* sizes   = getSizes();
+        for (size_t i = 0, end = 0; i < nLines; ++i)
+        {
+            // Every line is followed by its terminator, so the next one starts further
+            if (offsets[i] < getNHeader() || (i > 0 && offsets[i] <= end))
+                return false;
+
+            end = (size_t) offsets[i] + sizes[i];
+            if (end > nSymbols)
+                return false;
+        }
+
+        std::vector<char> isSeen(nLines);
+        for (bool reversed : {false, true})
+        {
+            const uint32_t* order = getOrder(reversed);
+            std::fill(isSeen.begin(), isSeen.end(), false);
+
+            for (size_t i = 0; i < nLines; ++i)
+            {
+                if (order[i] >= nLines || isSeen[order[i]])
+                    return false;
+                isSeen[order[i]] = true;
+            }
+        }
+
+        return true;
+    }
+
+    size_t getNLines()  const { return getHeader()->nLines; }
+    size_t getNHeader() const { return getHeader()->nHeader; }
+
+    const uint32_t* getOffsets() const { return getTable(TABLE_OFFSETS); }
+    const uint32_t* getSizes()   const { return getTable(TABLE_SIZES); }
+
+    /*!
+     * Sorted order as indices of original lines
+     * @param reversed Whether order by line endings is wanted
+     */
+    const uint32_t* getOrder(bool reversed) const
+    {
+        return getTable(reversed ? TABLE_REVERSE : TABLE_FORWARD);
+    }
+
+    /*!
+     * Writes index file
+     * @param filename Path to index file
+     * @param text Text in original order
+     * @param stamp Stamp of input text was read from
+     * @param orderFlags Result of getOrderFlags
+     * @param forward, reverse Sorted orders written by Text::getPermutation
+     * @return false if file can not be written or text is too large for 32-bit offsets
+     */
+    template <typename CharT>
+    static bool write(const char* filename, const BasicText<CharT>& text, const InputStamp& stamp,
+                      uint32_t orderFlags, const std::vector<uint32_t>& forward, const std::vector<uint32_t>& reverse)
+    {
+        size_t nLines = text.getNLines();
+        if (text.getNSymbols() >= UINT32_MAX || forward.size() != nLines || reverse.size() != nLines)
+            return false;
+
+        FileHeader header = {};
+        memcpy(header.magic, FILE_MAGIC_, sizeof(header.magic));
+        header.version    = FILE_VERSION_;
+        header.unitSize   = sizeof(CharT);
+        header.orderFlags = orderFlags;
+        header.stamp      = stamp;
+        header.nSymbols   = text.getNSymbols();
+        header.nHeader    = text.getNHeader();
+        header.nLines     = nLines;
+
+        std::vector<uint32_t> offsets(nLines), sizes(nLines);
+        for (size_t i = 0; i < nLines; ++i)
+        {
+            offsets[i] = text[i].getPtr() - text.getBuffer();
+            sizes[i]   = text[i].getSize();
+        }
+
+        FILE* output = fopen(filename, "wb");
+        if (!output)
+            return false;
+
+        bool written = fwrite(&header, sizeof(header), 1, output) == 1 &&
+                       fwrite(offsets.data(), sizeof(uint32_t), nLines, output) == nLines &&
+                       fwrite(sizes.data(),   sizeof(uint32_t), nLines, output) == nLines &&
+                       fwrite(forward.data(), sizeof(uint32_t), nLines, output) == nLines &&
+                       fwrite(reverse.data(), sizeof(uint32_t), nLines, output) == nLines;
+
+        return (fclose(output) == 0) && written;
+    }
+};
+
+/*!
+ * How produceIndexedVersions got the sorted orders
+ */
+enum IndexUsage
+{
+    INDEX_REUSED,  //!< Index matched input, nothing was sorted
+    INDEX_WRITTEN, //!< Text was sorted and index was written
+    INDEX_FAILED   //!< Text was sorted, but index could not be written
+};
+
+/*!
+ * Same as produceVersions, but sorted orders are taken from index file if it was built <br>
+ * for the same input and sorting options and its tables are consistent. Otherwise text <br>
+ * is split and fully sorted in both directions and the index is written for the next run
+ * @param text Text with input read by readRawFromFile, not split yet
+ * @param inputFilename Path to input file
+ * @param indexFilename Path to index file
+ * @param options Which versions are needed
+ * @param consume Callable taking text and maximal number of its first lines to output
+ * @see produceVersions
+ */
+template <typename CharT, typename Consumer>
+IndexUsage produceIndexedVersions(BasicText<CharT>& text, const char* inputFilename, const char* indexFilename,
+                                  const PrintOptions& options, Consumer consume)
+{
+    InputStamp stamp = InputStamp::make(inputFilename, text);
+    uint32_t orderFlags = SortedIndex::getOrderFlags(options);
+
+    SortedIndex index;
+    if (index.open(indexFilename) && index.matches(stamp, sizeof(CharT), orderFlags, text.getNSymbols()) &&
+        index.isConsistent(text.getNSymbols()) &&
+        text.assignLines(index.getNHeader(), index.getNLines(), index.getOffsets(), index.getSizes()))
+    {
+        PrintOptions indexedOptions = options;
+        indexedOptions.unique = false; // Index keeps lines left after removal
+
+        produceVersions(text, indexedOptions, consume, [&index](BasicText<CharT>& version, bool reversed)
+        {
+            version.setPermutation(index.getOrder(reversed));
+        });
+
+        return INDEX_REUSED;
+    }
+
+    index.close();
+    text.splitLines();
+
+    PrintOptions fullOptions = options;
+    fullOptions.top = 0;
+
+    std::vector<uint32_t> orders[2];
+    BasicFieldTable<CharT> fields;
+    auto sortAndRemember = [&fullOptions, &orders, &fields](BasicText<CharT>& version, bool reversed)
+    {
+        sortDirection(version, reversed, fullOptions, &fields);
+        orders[reversed].resize(version.getNLines());
+        version.getPermutation(orders[reversed].data());
+    };
+
+    produceVersions(text, options, consume, sortAndRemember);
+
+    for (bool reversed : {false, true})
+        if (orders[reversed].empty())
+            sortAndRemember(text, reversed);
+
+    text.recoverOriginal();
+    bool isWritten = SortedIndex::write(indexFilename, text, stamp, orderFlags, orders[false], orders[true]);
+    return isWritten ? INDEX_WRITTEN : INDEX_FAILED;
+}
+
+#endif /* SORTED_INDEX_H_INCLUDED */
@@ -0,0 +1,398 @@
+/*!
+ * \file
+ * \brief
+ * \details Suffix array of a whole text for lookups of any substring
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef SUFFIX_ARRAY_H_INCLUDED
+#define SUFFIX_ARRAY_H_INCLUDED
+
+#include "Text.h"
+
+/*!
+ * \brief Sorted suffixes of all lines of a text
+ *
+ * Suffixes of the text buffer are sorted by SA-IS in linear time. Line ends are <br>
+ * sentinels less than any symbol, so substrings never run from one line into another. <br>
+ * Code units are compared as they are, service symbols are not skipped. <br>
+ * Any substring is found by binary search in O(m log n) <br>
+ * Array refers to buffer of text, so text must outlive it
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicSuffixArray
+{
+public:
+    typedef std::pair<size_t, size_t> Range; //!< Half-open range of positions in array
+
+private:
+    typedef typename std::make_unsigned<CharT>::type Unit;
+
+    static const uint32_t END_       = 0; //!< Symbol of the single terminating suffix
+    static const uint32_t SEPARATOR_ = 1; //!< Symbol of every line end
+
+    const CharT* data_;             //!< First symbol of the first line
+    size_t offset_;                 //!< Position of data_ in text buffer
+    size_t size_;                   //!< Number of symbols from data_ to the end of buffer
+    std::vector<int32_t> suffixes_; //!< Starts of suffixes in sorted order
+    std::vector<int32_t> lcp_;      //!< Common prefix of every suffix with the previous one
+
+    static bool isSeparator(CharT sym)
+    {
+        return sym == CharT(0) || sym == CharT('\n');
+    }
+
+    /*!
+     * Counts symbols and writes start or end of every bucket
+     */
+    static void getBuckets(const uint32_t* str, size_t n, size_t alphabet, std::vector<int32_t>* buckets, bool ends)
+    {
+        buckets->assign(alphabet, 0);
+        for (size_t i = 0; i < n; ++i)
+            ++(*buckets)[str[i]];
+
+        int32_t sum = 0;
+        for (int32_t& bucket : *buckets)
+        {
+            sum += bucket;
+            bucket = ends ? sum : sum - bucket;
+        }
+    }
+
+    /*!
+     * Places L-type suffixes after their sorted successors
+     */
+    static void induceL(const uint32_t* str, const std::vector<bool>& types, int32_t* sa, size_t n,
+                        size_t alphabet, std::vector<int32_t>* buckets)
+    {
+        getBuckets(str, n, alphabet, buckets, false);
+        for (size_t i = 0; i < n; ++i)
+        {
+            int32_t prev = sa[i] - 1;
+            if (sa[i] > 0 && !types[prev])
+                sa[(*buckets)[str[prev]]++] = prev;
+        }
+    }
+
+    /*!
+     * Places S-type suffixes before their sorted successors
+     */
+    static void induceS(const uint32_t* str, const std::vector<bool>& types, int32_t* sa, size_t n,
+                        size_t alphabet, std::vector<int32_t>* buckets)
+    {
+        getBuckets(str, n, alphabet, buckets, true);
+        for (size_t i = n; i-- > 0; )
+        {
+            int32_t prev = sa[i] - 1;
+            if (sa[i] > 0 && types[prev])
+                sa[--(*buckets)[str[prev]]] = prev;
+        }
+    }
+
+    /*!
+     * SA-IS: sorts suffixes of string ending with unique least symbol
+     * @param str String of symbols below alphabet, str[n - 1] is 0 and occurs once
+     * @param sa Place for n sorted suffixes
+     * @param n Length of string
+     * @param alphabet Number of different symbols
+     */
+    static void sortSuffixes(const uint32_t* str, int32_t* sa, size_t n, size_t alphabet)
+    {
+        if (n == 1)
+        {
+            sa[0] = 0;
+            return;
+        }
+
+        std::vector<bool> types(n, false); // true for S-type
+        types[n - 1] = true;
+        for (size_t i = n - 1; i-- > 0; )
+            types[i] = str[i] < str[i + 1] || (str[i] == str[i + 1] && types[i + 1]);
+
+        auto isLms = [&types](size_t i)
+        {
+            return i > 0 && types[i] && !types[i - 1];
+        };
+
+        std::vector<int32_t> buckets;
+        getBuckets(str, n, alphabet, &buckets, true);
+        std::fill(sa, sa + n, -1);
+        for (size_t i = 1; i < n; ++i)
+            if (isLms(i))
+                sa[--buckets[str[i]]] = i;
+
+        induceL(str, types, sa, n, alphabet, &buckets);
+        induceS(str, types, sa, n, alphabet, &buckets);
+
+        size_t nLms = 0;
+        for (size_t i = 0; i < n; ++i)
+            if (isLms(sa[i]))
+                sa[nLms++] = sa[i];
+
+        std::fill(sa + nLms, sa + n, -1);
+
+        size_t nNames = 0;
+        int32_t prev = -1;
+        for (size_t i = 0; i < nLms; ++i)
+        {
+            int32_t pos = sa[i];
+            bool isDifferent = false;
+
+            for (size_t d = 0; d < n; ++d)
+            {
+                if (prev == -1 || str[pos + d] != str[prev + d] || types[pos + d] != types[prev + d])
+                {
+                    isDifferent = true;
+                    break;
+                }
+                if (d > 0 && (isLms(pos + d) || isLms(prev + d)))
+                    break;
+            }
+
+            if (isDifferent)
+            {
+                ++nNames;
+                prev = pos;
+            }
+
+            sa[nLms + pos / 2] = nNames - 1;
+        }
+
+        std::vector<uint32_t> reduced;
+        reduced.reserve(nLms);
+        for (size_t i = nLms; i < n; ++i)
+            if (sa[i] >= 0)
+                reduced.push_back(sa[i]);
+
+        if (nNames < nLms)
+            sortSuffixes(reduced.data(), sa, nLms, nNames);
+        else
+            for (size_t i = 0; i < nLms; ++i)
+                sa[reduced[i]] = i;
+
+        for (size_t i = 1, j = 0; i < n; ++i)
+            if (isLms(i))
+                reduced[j++] = i;
+
+        for (size_t i = 0; i < nLms; ++i)
+            sa[i] = reduced[sa[i]];
+
+        std::fill(sa + nLms, sa + n, -1);
+        getBuckets(str, n, alphabet, &buckets, true);
+        for (size_t i = nLms; i-- > 0; )
+        {
+            int32_t pos = sa[i];
+            sa[i] = -1;
+            sa[--buckets[str[pos]]] = pos;
+        }
+
+        induceL(str, types, sa, n, alphabet, &buckets);
+        induceS(str, types, sa, n, alphabet, &buckets);
+    }
+
+    /*!
+     * Compares beginning of suffix with pattern
+     * @return Negative if suffix is less than all strings starting with pattern, <br>
+     *         0 if it starts with pattern, positive otherwise
+     */
+    int comparePattern(size_t index, const CharT* pattern, size_t size) const
+    {
+        const CharT* suffix = data_ + suffixes_[index];
+        size_t rest = size_ - suffixes_[index];
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (i == rest || isSeparator(suffix[i]))
+                return -1;
+            if ((Unit) suffix[i] != (Unit) pattern[i])
+                return ((Unit) suffix[i] < (Unit) pattern[i]) ? -1 : 1;
+        }
+
+        return 0;
+    }
+
+    /*!
+     * Kasai algorithm: common prefixes of neighbours in linear time <br>
+     * Prefixes stop at line ends
+     * @param str Renamed symbols of text the array was built for
+     */
+    void computeLcp(const std::vector<uint32_t>& str)
+    {
+        std::vector<int32_t> ranks(size_);
+        for (size_t i = 0; i < size_; ++i)
+            ranks[suffixes_[i]] = i;
+
+        lcp_.assign(size_, 0);
+        size_t common = 0;
+
+        for (size_t i = 0; i < size_; ++i)
+        {
+            if (ranks[i] == 0)
+            {
+                common = 0;
+                continue;
+            }
+
+            size_t prev = suffixes_[ranks[i] - 1];
+            while (i + common < size_ && prev + common < size_ && str[i + common] == str[prev + common] &&
+                   str[i + common] != SEPARATOR_)
+            {
+                ++common;
+            }
+
+            lcp_[ranks[i]] = common;
+            if (common > 0)
+                --common;
+        }
+    }
+
+public:
+    BasicSuffixArray():
+        data_(nullptr),
+        offset_(0),
+        size_(0)
+    {}
+
+    /*!
+     * Sorts all suffixes of loaded text
+     * @param text Text split into lines
+     * @param needLcp Whether to compute longest common prefixes of neighbour suffixes
+     */
+    void build(const BasicText<CharT>& text, bool needLcp = false)
+    {
+        offset_ = text.getNHeader();
+        data_   = text.getBuffer() + offset_;
+        size_   = text.getNSymbols() - offset_;
+        ASSERT(size_ < (size_t) INT32_MAX, "Text is too large for suffix array");
+
+        uint32_t maxUnit = 0;
+        for (size_t i = 0; i < size_; ++i)
+            maxUnit = std::max<uint32_t>(maxUnit, (Unit) data_[i]);
+
+        // Used units are renamed to dense symbols above END_ and SEPARATOR_
+        std::vector<uint32_t> names(maxUnit + 1, 0);
+        for (size_t i = 0; i < size_; ++i)
+            names[(Unit) data_[i]] = 1;
+
+        uint32_t alphabet = SEPARATOR_ + 1;
+        for (uint32_t& name : names)
+            name = name ? alphabet++ : 0;
+
+        std::vector<uint32_t> str(size_ + 1);
+        for (size_t i = 0; i < size_; ++i)
+            str[i] = isSeparator(data_[i]) ? SEPARATOR_ : names[(Unit) data_[i]];
+        str[size_] = END_;
+
+        names = std::vector<uint32_t>();
+
+        suffixes_.resize(size_ + 1);
+        sortSuffixes(str.data(), suffixes_.data(), size_ + 1, alphabet);
+        suffixes_.erase(suffixes_.begin());
+
+        lcp_.clear();
+        if (needLcp)
+            computeLcp(str);
+    }
+
+    size_t size() const { return suffixes_.size(); }
+
+    /*!
+     * Position of start of i-th suffix in text buffer
+     */
+    size_t operator [](size_t index) const
+    {
+        ASSERT(index < suffixes_.size(), "Out of suffix array range");
+        return offset_ + suffixes_[index];
+    }
+
+    /*!
+     * Whether build() was asked for common prefixes
+     */
+    bool hasLcp() const { return !lcp_.empty(); }
+
+    /*!
+     * Length of common prefix of i-th suffix and the previous one, 0 for the first
+     */
+    size_t getLcp(size_t index) const
+    {
+        ASSERT(index < lcp_.size(), "Out of LCP array range");
+        return lcp_[index];
+    }
+
+    /*!
+     * Suffixes starting with pattern
+     * @param pattern, size Substring to look for, without line ends
+     * @return Half-open range of positions in array
+     */
+    Range find(const CharT* pattern, size_t size) const
+    {
+        size_t first = 0, last = suffixes_.size();
+        while (first < last)
+        {
+            size_t middle = first + (last - first) / 2;
+            if (comparePattern(middle, pattern, size) < 0)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+
+        size_t end = suffixes_.size();
+        last = first;
+        while (last < end)
+        {
+            size_t middle = last + (end - last) / 2;
+            if (comparePattern(middle, pattern, size) == 0)
+                last = middle + 1;
+            else
+                end = middle;
+        }
+
+        return Range(first, last);
+    }
+
+    /*!
+     * Lines containing pattern
+     * @param text Text the array was built for, in original order
+     * @param pattern, size Substring to look for, without line ends
+     * @return Indices of lines in increasing order, every line once
+     */
+    std::vector<size_t> findLines(const BasicText<CharT>& text, const CharT* pattern, size_t size) const
+    {
+        Range found = find(pattern, size);
+
+        std::vector<size_t> positions;
+        positions.reserve(found.second - found.first);
+        for (size_t i = found.first; i < found.second; ++i)
+            positions.push_back((*this)[i]);
+
+        std::sort(positions.begin(), positions.end());
+
+        std::vector<size_t> lines;
+        for (size_t position : positions)
+        {
+            const CharT* ptr = text.getBuffer() + position;
+
+            size_t first = 0, last = text.getNLines();
+            while (last - first > 1)
+            {
+                size_t middle = first + (last - first) / 2;
+                if (text[middle].getPtr() <= ptr)
+                    first = middle;
+                else
+                    last = middle;
+            }
+
+            if (lines.empty() || lines.back() != first)
+                lines.push_back(first);
+        }
+
+        return lines;
+    }
+};
+
+typedef BasicSuffixArray<char16_t> SuffixArray;     //!< Suffix array of UTF-16 text
+typedef BasicSuffixArray<char>     Utf8SuffixArray; //!< Suffix array of UTF-8 text
+
+#endif /* SUFFIX_ARRAY_H_INCLUDED */
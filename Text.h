@@ -2,7 +2,7 @@
 /*!
  * \file
  * \brief
- * \details Interface for working with text files in UTF-16. Methods for quick line sorting are provided.
+ * \details Interface for working with text files in UTF-16, UTF-8 and UTF-32. Methods for quick line sorting are provided.
  * \author Roman Loginov
  * \version 1.0
  */
@@ -19,18 +19,35 @@
  * Hope you will like this.
  */
 
+#ifndef TEXT_H_INCLUDED
+#define TEXT_H_INCLUDED
+
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <cassert>
 #include <cwchar>
 #include <algorithm>
-#include <endian.h>
 #include <cmath>
 #include <functional>
 #include <cstring>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <climits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "AsyncIO.h"
+#include "Utf8.h"
+#include "SortKeys.h"
+#include "AdaptiveSort.h"
 
 #define ASSERT(COND, MSG)                                       \
     if(!(COND))                                                 \
@@ -47,15 +64,28 @@
 const char16_t UTF16_NEWLINE = char16_t(0xfeff000a);
 
 /*!
- * Compares symbols in little-endian utf-16 lexicographically
- * @param c1, c2 2-bytr Unicode symbols
+ * Byte order mark in UTF-16
+ */
+const char16_t UTF16_BOM = char16_t(0xfeff);
+
+/*!
+ * Byte order mark of UTF-16 read with the other byte order
+ */
+const char16_t UTF16_SWAPPED_BOM = char16_t(0xfffe);
+
+/*!
+ * Whether native byte order of UTF-16 units is big-endian
+ */
+const bool UTF16_NATIVE_BIG_ENDIAN = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+/*!
+ * Compares native-endian utf-16 symbols lexicographically <br>
+ * Buffers of other byte order are swapped at load time, see utf16_byteswap
+ * @param c1, c2 2-byte Unicode symbols
  * @return -1 if c1 < c2, 0 if c1 == c2, otherwise 1
  */
-int utf16_comp_le(char16_t c1, char16_t c2)
+int utf16_comp(char16_t c1, char16_t c2)
 {
-    c1 = htobe16(c1);
-    c2 = htobe16(c2);
-    
     if (c1 < c2)
         return -1;
     else if (c1 == c2)
@@ -65,19 +95,141 @@ int utf16_comp_le(char16_t c1, char16_t c2)
 }
 
 /*!
- * strlen for UTF-16
- * @return Number of characters in str
+ * strlen for any code units
+ * @return Number of units before terminating zero
  */
-size_t utf16_strlen(const char16_t* str)
+template <typename CharT>
+size_t unit_strlen(const CharT* str)
 {
     size_t currentLen = 0;
 
-    while (str[currentLen] != L'\0')
+    while (str[currentLen] != CharT(0))
        currentLen += 1;
 
    return currentLen; 
 }
 
+/*!
+ * strlen for UTF-8 is the library one
+ */
+template <>
+size_t unit_strlen<char>(const char* str)
+{
+    return strlen(str);
+}
+
+#if WCHAR_MAX > 0xffff
+/*!
+ * strlen for UTF-32: wchar_t has the same width here, so library wcslen is used
+ */
+template <>
+size_t unit_strlen<char32_t>(const char32_t* str)
+{
+    static_assert(sizeof(wchar_t) == sizeof(char32_t), "wchar_t is expected to hold UTF-32");
+    return wcslen((const wchar_t*) str);
+}
+#endif
+
+/*!
+ * Finds the first given symbol in range <br>
+ * Specialized for every code unit, so line splitting uses the fastest scanner available
+ * @param begin, end Range to look in
+ * @param symbol Symbol to find
+ * @return Pointer to symbol found or end
+ */
+template <typename CharT>
+const CharT* unit_find(const CharT* begin, const CharT* end, CharT symbol)
+{
+    while (begin != end && *begin != symbol)
+        ++begin;
+
+    return begin;
+}
+
+/*!
+ * Symbol search in UTF-8 is memchr
+ */
+template <>
+const char* unit_find<char>(const char* begin, const char* end, char symbol)
+{
+    const char* found = (const char*) memchr(begin, symbol, end - begin);
+    return found ? found : end;
+}
+
+/*!
+ * Symbol search in UTF-16 compares 8 units at a time with SSE2
+ */
+template <>
+const char16_t* unit_find<char16_t>(const char16_t* begin, const char16_t* end, char16_t symbol)
+{
+#ifdef __SSE2__
+    __m128i pattern = _mm_set1_epi16((short) symbol);
+
+    for (; end - begin >= 8; begin += 8)
+    {
+        __m128i units = _mm_loadu_si128((const __m128i*) begin);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(units, pattern));
+
+        if (mask)
+            return begin + __builtin_ctz(mask) / sizeof(char16_t);
+    }
+#endif
+
+    while (begin != end && *begin != symbol)
+        ++begin;
+
+    return begin;
+}
+
+#if WCHAR_MAX > 0xffff
+/*!
+ * Symbol search in UTF-32 is wmemchr
+ */
+template <>
+const char32_t* unit_find<char32_t>(const char32_t* begin, const char32_t* end, char32_t symbol)
+{
+    const char32_t* found = (const char32_t*) wmemchr((const wchar_t*) begin, (wchar_t) symbol, end - begin);
+    return found ? found : end;
+}
+#endif
+
+/*!
+ * Counts given symbols in range using unit_find
+ * @param begin, end Range to look in
+ * @param symbol Symbol to count
+ */
+template <typename CharT>
+size_t unit_count(const CharT* begin, const CharT* end, CharT symbol)
+{
+    size_t answer = 0;
+
+    for (begin = unit_find(begin, end, symbol); begin != end; begin = unit_find(begin + 1, end, symbol))
+        ++answer;
+
+    return answer;
+}
+
+/*!
+ * std::string.count() analogue for any code units
+ * @param str String to find in
+ * @param symbol Symbol to find
+ * @return number of given symbols in str
+ */ 
+template <typename CharT>
+size_t unit_count(const CharT* str, CharT symbol)
+{
+    return unit_count(str, str + unit_strlen(str), symbol);
+}
+
+/*!
+ * strlen for UTF-16
+ * @return Number of characters in str
+ */
+size_t utf16_strlen(const char16_t* str)
+{
+    return unit_strlen(str);
+}
+
 /*!
  * std::string.count() analogue fo UTF-16
  * @param str String to find in
@@ -86,41 +238,550 @@ size_t utf16_strlen(const char16_t* str)
  */ 
 size_t utf16_count(const char16_t* str, char16_t symbol)
 {
-    size_t answer = 0;
+    return unit_count(str, symbol);
+}
+
+/*!
+ * Tells if UTF-16 unit is the first half of surrogate pair
+ */
+inline bool utf16_is_high_surrogate(char16_t unit)
+{
+    return unit >= 0xd800 && unit <= 0xdbff;
+}
+
+/*!
+ * Tells if UTF-16 unit is the second half of surrogate pair
+ */
+inline bool utf16_is_low_surrogate(char16_t unit)
+{
+    return unit >= 0xdc00 && unit <= 0xdfff;
+}
+
+/*!
+ * Tells if UTF-16 units contain any surrogate, 8 units at a time with SSE2
+ * @param units Units to look at
+ * @param size Number of units
+ */
+bool utf16_has_surrogates(const char16_t* units, size_t size)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i mask    = _mm_set1_epi16((short) 0xf800);
+    __m128i pattern = _mm_set1_epi16((short) 0xd800);
+
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (units + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, mask), pattern)))
+            return true;
+    }
+#endif
+
+    for (; i < size; ++i)
+        if ((units[i] & 0xf800) == 0xd800)
+            return true;
+
+    return false;
+}
+
+/*!
+ * Swaps bytes of every UTF-16 unit in place, 8 units at a time with SSE2
+ * @param buffer Units to swap
+ * @param size Number of units
+ */
+void utf16_byteswap(char16_t* buffer, size_t size)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i units = _mm_loadu_si128((const __m128i*) (buffer + i));
+        units = _mm_or_si128(_mm_slli_epi16(units, 8), _mm_srli_epi16(units, 8));
+        _mm_storeu_si128((__m128i*) (buffer + i), units);
+    }
+#endif
+
+    for (; i < size; ++i)
+        buffer[i] = char16_t((buffer[i] << 8) | (buffer[i] >> 8));
+}
+
+/*!
+ * Swaps bytes of every UTF-32 unit in place
+ * @param buffer Units to swap
+ * @param size Number of units
+ */
+void utf32_byteswap(char32_t* buffer, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        buffer[i] = __builtin_bswap32(buffer[i]);
+}
+
+/*!
+ * Count bytes in file
+ * @param filename Path to wanted file
+ * @return Number of bytes in file, if it is found, 0 otherwise
+ */
+size_t getFileBytesNumber(const char* filename)
+{
+    struct stat st = {};
+
+    if (stat(filename, &st) != 0)
+        return 0;
+    
+    return st.st_size;
+}
+
+/*!
+ * Get number of symbols in UTF-16 file
+ * @param filename Path to wanted file
+ * @return Number of symbols, if file is found, 0 otherwise
+ */
+size_t utf16_file_len(const char* filename)
+{
+    return getFileBytesNumber(filename) / sizeof(char16_t);
+}
+
+/*!
+ * Size of a large page on x86-64 and most of ARM64 kernels
+ */
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/*!
+ * Kind of memory pages which back an array
+ */
+enum PageBacking
+{
+    PAGES_HEAP,             //!< Ordinary new[], huge pages were not asked for
+    PAGES_REGULAR,          //!< Anonymous mapping, kernel refused to give huge pages
+    PAGES_TRANSPARENT_HUGE, //!< Anonymous mapping advised with MADV_HUGEPAGE and backed by huge pages
+    PAGES_HUGETLB           //!< Explicitly reserved pages obtained with MAP_HUGETLB
+};
+
+/*!
+ * Human-readable name of page backing, used in statistics
+ */
+const char* pageBackingName(PageBacking backing)
+{
+    switch (backing)
+    {
+        case PAGES_HEAP:             return "heap";
+        case PAGES_REGULAR:          return "4K pages";
+        case PAGES_TRANSPARENT_HUGE: return "transparent huge pages";
+        case PAGES_HUGETLB:          return "hugetlb pages";
+    }
+
+    return "unknown";
+}
+
+/*!
+ * Rounds number of bytes up to the whole number of huge pages
+ */
+size_t roundToHugePages(size_t bytes)
+{
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+/*!
+ * Number of bytes backed by transparent huge pages in the mapping which holds address <br>
+ * Taken from AnonHugePages of /proc/self/smaps, so pages count only after they are touched
+ * @param addr Address inside mapping
+ * @return 0 if there are none or smaps can not be read
+ */
+size_t getAnonHugeBytes(const void* addr)
+{
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+        return 0;
+
+    uintptr_t target = (uintptr_t) addr;
+    bool isInside = false;
+    size_t hugeBytes = 0;
+    char line[512] = "";
+
+    while (fgets(line, sizeof(line), smaps))
+    {
+        unsigned long begin = 0, end = 0;
+        size_t kBytes = 0;
+
+        if (sscanf(line, "%lx-%lx ", &begin, &end) == 2 && strchr(line, '-') < strchr(line, ' '))
+        {
+            if (isInside)
+                break;
+            isInside = begin <= target && target < end;
+        }
+        else if (isInside && sscanf(line, "AnonHugePages: %zu kB", &kBytes) == 1)
+        {
+            hugeBytes = kBytes * 1024;
+            break;
+        }
+    }
+
+    fclose(smaps);
+    return hugeBytes;
+}
+
+/*!
+ * \brief Maps memory with 2 MB pages if kernel allows it
+ * Tries reserved MAP_HUGETLB pages first. If there are none, maps 2 MB-aligned <br>
+ * region and asks for transparent huge pages with madvise. Advice may be accepted <br>
+ * without huge pages given, e.g. with THP set to never, so PAGES_TRANSPARENT_HUGE <br>
+ * here means only asked for, see allocateArray
+ * @param bytes Number of bytes required
+ * @param backing Place to write kind of pages obtained or asked for
+ * @return Zeroed memory of roundToHugePages(bytes) size, nullptr on failure
+ */
+void* mapHugePages(size_t bytes, PageBacking* backing)
+{
+    assert(backing);
+    size_t size = roundToHugePages(bytes);
+
+#ifdef MAP_HUGETLB
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+    {
+        *backing = PAGES_HUGETLB;
+        return mem;
+    }
+#endif
+
+    char* raw = (char*) mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return nullptr;
+
+    char* aligned = (char*) roundToHugePages((size_t) raw);
+    if (aligned != raw)
+        munmap(raw, aligned - raw);
+    munmap(aligned + size, raw + HUGE_PAGE_SIZE - aligned);
+
+    *backing = PAGES_REGULAR;
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0)
+        *backing = PAGES_TRANSPARENT_HUGE;
+#endif
+
+    return aligned;
+}
+
+/*!
+ * Allocates array of default-constructed elements
+ * @param n Number of elements
+ * @param hugePages Whether to try 2 MB pages
+ * @param backing Place to write kind of pages actually obtained
+ * @see mapHugePages
+ */
+template <typename T>
+T* allocateArray(size_t n, bool hugePages, PageBacking* backing)
+{
+    assert(backing);
+
+    if (hugePages)
+    {
+        T* mem = (T*) mapHugePages(n * sizeof(T), backing);
+        if (mem)
+        {
+            std::uninitialized_fill_n(mem, n, T());
+
+            // Pages are touched now, so kernel tells whether advice gave huge pages
+            if (*backing == PAGES_TRANSPARENT_HUGE && getAnonHugeBytes(mem) == 0)
+                *backing = PAGES_REGULAR;
+
+            return mem;
+        }
+    }
+
+    *backing = PAGES_HEAP;
+    return new T[n]();
+}
+
+/*!
+ * Frees array got from allocateArray
+ * @param n Number of elements array was allocated with
+ * @param backing Pages the array was placed in
+ */
+template <typename T>
+void freeArray(T* array, size_t n, PageBacking backing)
+{
+    if (!array)
+        return;
+
+    if (backing == PAGES_HEAP)
+        delete[] array;
+    else
+        munmap(array, roundToHugePages(n * sizeof(T)));
+}
+
+/*!
+ * \brief Properties of a code unit type used by lines and texts
+ * Specialized for every supported character type
+ * @tparam CharT char for UTF-8, char16_t for UTF-16, char32_t for UTF-32
+ */
+template <typename CharT>
+struct CodeUnitTraits;
+
+/*!
+ * UTF-16 code units
+ */
+template <>
+struct CodeUnitTraits<char16_t>
+{
+    static const TextEncoding ENCODING = ENCODING_UTF16; //!< Encoding of files with these units
+
+    /*!
+     * Compares code units
+     * @see utf16_comp
+     */
+    static int compare(char16_t c1, char16_t c2)
+    {
+        return utf16_comp(c1, c2);
+    }
+
+    /*!
+     * Tells if line needs code point comparison instead of unit one
+     * @see utf16_has_surrogates
+     */
+    static bool hasSurrogates(const char16_t* units, size_t size)
+    {
+        return utf16_has_surrogates(units, size);
+    }
+
+    /*!
+     * Reads code point going in given direction, surrogate pair is joined into one <br>
+     * Unpaired surrogate is returned as it is
+     * @param ptr, start, direction Unit at index i is ptr[start + direction * i]
+     * @param size Number of units in line
+     * @param ind Index of unit to read, moved past the code point
+     */
+    static uint32_t readCodePoint(const char16_t* ptr, size_t start, size_t size, size_t* ind, int direction)
+    {
+        char16_t first = ptr[start + direction * *ind];
+        *ind += 1;
+
+        if (*ind >= size)
+            return first;
+
+        char16_t second = ptr[start + direction * *ind];
+        char16_t high   = (direction == 1) ? first  : second;
+        char16_t low    = (direction == 1) ? second : first;
+
+        if (!utf16_is_high_surrogate(high) || !utf16_is_low_surrogate(low))
+            return first;
+
+        *ind += 1;
+        return 0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00);
+    }
+
+    /*!
+     * Brings loaded buffer to native byte order <br>
+     * Byte order mark tells the order if it is present, otherwise encoding of file does: <br>
+     * buffer is taken as big-endian for ENCODING_UTF16BE and as native for the rest
+     * @param encoding Encoding file was read in
+     * @return Number of units before the first line: 1 for byte order mark, 0 without it
+     */
+    static size_t prepareBuffer(char16_t* buffer, size_t size, TextEncoding encoding)
+    {
+        if (size == 0)
+            return 0;
+
+        bool isBigEndian = (encoding == ENCODING_UTF16BE);
+        if (buffer[0] == UTF16_SWAPPED_BOM || (buffer[0] != UTF16_BOM && isBigEndian != UTF16_NATIVE_BIG_ENDIAN))
+            utf16_byteswap(buffer, size);
+
+        return buffer[0] == UTF16_BOM;
+    }
+};
+
+/*!
+ * UTF-32 code units <br>
+ * Every unit is a whole code point, so they are compared as numbers
+ */
+template <>
+struct CodeUnitTraits<char32_t>
+{
+    static const TextEncoding ENCODING = ENCODING_UTF32; //!< Encoding of files with these units
+
+    /*!
+     * Compares code points
+     */
+    static int compare(char32_t c1, char32_t c2)
+    {
+        return (c1 > c2) - (c1 < c2);
+    }
+
+    /*!
+     * UTF-32 has no surrogate pairs, unit order is code point order
+     */
+    static bool hasSurrogates(const char32_t* units, size_t size)
+    {
+        return false;
+    }
+
+    /*!
+     * Reads one unit, it is a code point already
+     */
+    static uint32_t readCodePoint(const char32_t* ptr, size_t start, size_t size, size_t* ind, int direction)
+    {
+        return ptr[start + direction * (*ind)++];
+    }
+
+    /*!
+     * Brings loaded buffer to native byte order, if byte order mark tells it is other
+     * @return Number of units before the first line: 1 for byte order mark, 0 without it
+     */
+    static size_t prepareBuffer(char32_t* buffer, size_t size, TextEncoding encoding)
+    {
+        if (size == 0)
+            return 0;
+
+        if (buffer[0] == __builtin_bswap32(char32_t(UTF16_BOM)))
+            utf32_byteswap(buffer, size);
+
+        return buffer[0] == char32_t(UTF16_BOM);
+    }
+};
+
+/*!
+ * UTF-8 code units <br>
+ * Byte order of UTF-8 is the order of code points, so bytes are compared as unsigned <br>
+ * going forward. Backward comparison steps over whole code points, see readCodePoint
+ */
+template <>
+struct CodeUnitTraits<char>
+{
+    static const TextEncoding ENCODING = ENCODING_UTF8; //!< Encoding of files with these units
+
+    /*!
+     * Compares bytes as unsigned numbers
+     */
+    static int compare(char c1, char c2)
+    {
+        return (int) (unsigned char) c1 - (int) (unsigned char) c2;
+    }
+
+    /*!
+     * UTF-8 has no surrogate pairs, byte order is code point order
+     */
+    static bool hasSurrogates(const char* units, size_t size)
+    {
+        return false;
+    }
+
+    /*!
+     * Reads code point going in given direction, multibyte sequence is decoded as a whole <br>
+     * Going backward, continuation bytes are stepped over to the leading one <br>
+     * Byte out of well-formed sequence is returned as it is
+     * @param ptr, start, direction Unit at index i is ptr[start + direction * i]
+     * @param size Number of units in line
+     * @param ind Index of unit to read, moved past the code point
+     */
+    static uint32_t readCodePoint(const char* ptr, size_t start, size_t size, size_t* ind, int direction)
+    {
+        const unsigned char* units = (const unsigned char*) ptr;
+        size_t pos = start + direction * *ind;
+
+        // Sequence is [first, first + available), backward it has to end at pos
+        size_t first = pos, available = size - *ind;
+        if (direction == -1)
+        {
+            while (pos - first < 3 && pos - first + 1 < available && utf8_is_continuation(units[first]))
+                --first;
+            available = pos - first + 1;
+        }
+
+        size_t length = 1;
+        uint32_t code = utf8_decode(units + first, available, &length);
+        if ((length == 1 && units[first] >= 0x80) || (direction == -1 && length != available))
+        {
+            *ind += 1;
+            return units[pos];
+        }
+
+        *ind += length;
+        return code;
+    }
+
+    /*!
+     * UTF-8 has no byte order, buffer is left as it is
+     * @return Number of units before the first line: 3 for byte order mark, 0 without it
+     */
+    static size_t prepareBuffer(const char* buffer, size_t size, TextEncoding encoding)
+    {
+        return (size >= 3 && memcmp(buffer, "\xef\xbb\xbf", 3) == 0) ? 3 : 0;
+    }
+};
+
+/*!
+ * Length of common beginning of two arrays <br>
+ * Compares 8 bytes at a time
+ * @param lhs, rhs Arrays to compare
+ * @param size Number of units to look at
+ */
+template <typename CharT>
+size_t commonPrefixLength(const CharT* lhs, const CharT* rhs, size_t size)
+{
+    const size_t UNITS_IN_WORD = sizeof(uint64_t) / sizeof(CharT);
     size_t i = 0;
 
-    while (str[i] != L'\0')
+    for (; i + UNITS_IN_WORD <= size; i += UNITS_IN_WORD)
     {
-        answer += (str[i] == symbol);
-        i += 1;
+        uint64_t lhsWord = 0, rhsWord = 0;
+        memcpy(&lhsWord, lhs + i, sizeof(uint64_t));
+        memcpy(&rhsWord, rhs + i, sizeof(uint64_t));
+
+        if (lhsWord != rhsWord)
+            break;
     }
 
-    return answer;
+    while (i < size && lhs[i] == rhs[i])
+        ++i;
+
+    return i;
 }
 
 /*!
- * Count bytes in file
- * @param filename Path to wanted file
- * @return Number of bytes in file, if it is found, 0 otherwise
+ * Length of common ending of two arrays <br>
+ * Compares 8 bytes at a time
+ * @param lhsEnd, rhsEnd Pointers after the last units of arrays
+ * @param size Number of units to look at
  */
-size_t getFileBytesNumber(const char* filename)
+template <typename CharT>
+size_t commonSuffixLength(const CharT* lhsEnd, const CharT* rhsEnd, size_t size)
 {
-    struct stat st = {};
+    const size_t UNITS_IN_WORD = sizeof(uint64_t) / sizeof(CharT);
+    size_t i = 0;
 
-    if (stat(filename, &st) != 0)
-        return 0;
-    
-    return st.st_size;
+    for (; i + UNITS_IN_WORD <= size; i += UNITS_IN_WORD)
+    {
+        uint64_t lhsWord = 0, rhsWord = 0;
+        memcpy(&lhsWord, lhsEnd - i - UNITS_IN_WORD, sizeof(uint64_t));
+        memcpy(&rhsWord, rhsEnd - i - UNITS_IN_WORD, sizeof(uint64_t));
+
+        if (lhsWord != rhsWord)
+            break;
+    }
+
+    while (i < size && lhsEnd[-1 - (ptrdiff_t) i] == rhsEnd[-1 - (ptrdiff_t) i])
+        ++i;
+
+    return i;
 }
 
 /*!
- * Get number of symbols in UTF-16 file
- * @param filename Path to wanted file
- * @return Number of symbols, if file is found, 0 otherwise
+ * Builds bit mask of ASCII symbols below 64
+ * @param symbols Zero-terminated list of symbols
  */
-size_t utf16_file_len(const char* filename)
+constexpr uint64_t asciiMask(const char* symbols)
 {
-    return getFileBytesNumber(filename) / sizeof(char16_t);
+    uint64_t mask = 0;
+
+    for (; *symbols; ++symbols)
+        if ((unsigned char) *symbols < 64)
+            mask |= uint64_t(1) << (unsigned char) *symbols;
+
+    return mask;
 }
 
 /*!
@@ -128,33 +789,28 @@ size_t utf16_file_len(const char* filename)
  *
  * String of a file with useful functions to work with <br>
  * Just a part of whole buffer, no use of dynamic memory
+ * @tparam CharT Code unit: char16_t for UTF-16, char for UTF-8, char32_t for UTF-32
  */
-class IntegratedString
+template <typename CharT>
+class BasicIntegratedString
 {
 private:
-    const char16_t* ptr_; //!< Pointer to the beginning
-    size_t size_;         //!< Length of line
-    
-    static constexpr const size_t    N_PROHIBITED_ = 11;              //!< Number of skipped symbols
-    static constexpr const char16_t*   PROHIBITED_ = u".,!:;\"?-() "; //!< Skipped symbols
-    
-    /*!
-     * Tell if symbol is service and should be skipped during a sort
-     */
-    bool isProhibitedSymbol(char16_t sym) const
-    {
-        for (size_t i = 0; i < N_PROHIBITED_; ++i)
-            if (PROHIBITED_[i] == sym)
-                return true;
+    typedef CodeUnitTraits<CharT> Traits;
 
-        return false;    
-    }
+    const CharT* ptr_; //!< Pointer to the beginning
+    size_t size_;      //!< Length of line, the highest bit marks lines with surrogate pairs
+
+    static constexpr const size_t SURROGATES_FLAG_ = ~(~size_t(0) >> 1); //!< Bit of size_ for lines with surrogates
+    
+    static constexpr const size_t  N_PROHIBITED_ = 11;                        //!< Number of skipped symbols
+    static constexpr const char*     PROHIBITED_ = ".,!:;\"?-() ";            //!< Skipped symbols
+    static constexpr const uint64_t PROHIBITED_MASK_ = asciiMask(PROHIBITED_); //!< Skipped symbols as bits
     
     /*!
      * Skip service symbol and advance pointer given
      * Service function for comparator
      */
-    bool skipProhibited(const char16_t* ptr, size_t start, size_t* ind, int direction) const
+    bool skipProhibited(const CharT* ptr, size_t start, size_t* ind, int direction) const
     {
         if (isProhibitedSymbol(ptr[start + direction * *ind]))
         {
@@ -169,7 +825,7 @@ private:
      * Moves index to direction order while symbol is service
      * Service function for comparator
      */
-    void advanceUntilNotProhibited(const char16_t* ptr, size_t start, size_t size, size_t* ind, int direction) const
+    void advanceUntilNotProhibited(const CharT* ptr, size_t start, size_t size, size_t* ind, int direction) const
     {
         while (*ind < size && isProhibitedSymbol(ptr[start + direction * (*ind)]))
         {
@@ -178,20 +834,95 @@ private:
     }
 
     /*!
-     * \brief Directional UTF-16 string comparator
+     * Finalizer of 64-bit hash, spreads every input bit over the whole word
+     */
+    static uint64_t mixHash(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        return hash ^ (hash >> 33);
+    }
+
+    /*!
+     * Packs length of line and its surrogates flag into one word <br>
+     * Lines are checked once when they are made, so comparison of common lines <br>
+     * never looks for surrogates
+     */
+    static size_t packSize(const CharT* ptr, size_t size)
+    {
+        return Traits::hasSurrogates(ptr, size) ? (size | SURROGATES_FLAG_) : size;
+    }
+
+    /*!
+     * Directional comparator by whole code points <br>
+     * Used when at least one of lines has surrogate pairs and for backward UTF-8
+     * @param common Number of units known to be equal in both lines, it ends at a code point border
+     * @see directionalCompare
+     */
+    bool codePointCompare(const BasicIntegratedString& that, size_t startLHS, size_t startRHS, int direction,
+                          size_t common = 0) const
+    {
+        size_t indLHS = common, indRHS = common;
+
+        while (indLHS < getSize() && indRHS < that.getSize())
+        {
+            if (skipProhibited(     ptr_, startLHS, &indLHS, direction) ||
+                skipProhibited(that.ptr_, startRHS, &indRHS, direction))
+            {
+                continue;
+            }
+
+            uint32_t lhs = Traits::readCodePoint(     ptr_, startLHS,      getSize(), &indLHS, direction);
+            uint32_t rhs = Traits::readCodePoint(that.ptr_, startRHS, that.getSize(), &indRHS, direction);
+
+            if (lhs != rhs)
+                return lhs < rhs;
+        }
+
+        advanceUntilNotProhibited(     ptr_, startLHS,      getSize(), &indLHS, direction);
+        advanceUntilNotProhibited(that.ptr_, startRHS, that.getSize(), &indRHS, direction);
+
+        return (indLHS >= getSize() && indRHS < that.getSize());
+    }
+
+    /*!
+     * \brief Directional string comparator
      * By choosing a direction goes from given starts and determines if <br>
      * resulting string is than given another got with the same way <br>
-     * Skips service symbols
+     * Skips service symbols <br>
+     * Identical beginning (or ending) of lines is passed by whole words first: <br>
+     * service symbols are at the same places there, so it can not change result <br>
+     * Lines with surrogate pairs and UTF-8 lines going backward are compared by code points, <br>
+     * see codePointCompare
      * @param that String to compare with
      * @param startLHS, startRHS Place from where to start line formation
      * @param direction 1 for moving to the end of string, -1 otherwise
      * @result Result of operator < on resulted strings
      */
-    bool directionalCompare(const IntegratedString& that, size_t startLHS = 0, size_t startRHS = 0, int direction = 1) const
+    bool directionalCompare(const BasicIntegratedString& that, size_t startLHS = 0, size_t startRHS = 0, int direction = 1) const
     {
         ASSERT(abs(direction) == 1, "Directional comparator called with undefined direction (not +-1)");
+
+        if ((size_ | that.size_) & SURROGATES_FLAG_)
+            return codePointCompare(that, startLHS, startRHS, direction);
         
-        size_t indLHS = 0, indRHS = 0;
+        size_t minSize = std::min(getSize(), that.getSize());
+        size_t common  = (direction == 1) ? commonPrefixLength(ptr_, that.ptr_, minSize)
+                                          : commonSuffixLength(ptr_ + getSize(), that.ptr_ + that.getSize(), minSize);
+
+        // Bytes of UTF-8 code point go in reverse order of their weight, so common ending
+        // is cut to the start of a code point and the rest is compared by code points
+        if (sizeof(CharT) == 1 && direction == -1)
+        {
+            while (common > 0 && utf8_is_continuation(ptr_[getSize() - common]))
+                --common;
+
+            return codePointCompare(that, startLHS, startRHS, direction, common);
+        }
+
+        size_t indLHS = common, indRHS = common;
 
         while (indLHS < getSize() && indRHS < that.getSize())
         {
@@ -201,8 +932,8 @@ private:
                 continue;
             }
 
-            int comp_res = utf16_comp_le(     ptr_[startLHS + direction * indLHS], 
-                                         that.ptr_[startRHS + direction * indRHS]);
+            int comp_res = Traits::compare(     ptr_[startLHS + direction * indLHS], 
+                                           that.ptr_[startRHS + direction * indRHS]);
             ++indLHS;
             ++indRHS; 
 
@@ -219,30 +950,48 @@ private:
     } 
     
 public:
-    IntegratedString():
+    BasicIntegratedString():
         ptr_(nullptr),
         size_(0)
     {}
     
     /*!
      * Construct from pointer until the end <br>
-     * Uses utf16_strlen(ptr)
+     * Uses unit_strlen(ptr)
      */
-    explicit IntegratedString(const char16_t* ptr):
+    explicit BasicIntegratedString(const CharT* ptr):
+        ptr_(ptr),
+        size_(packSize(ptr, unit_strlen(ptr)))
+    {}
+
+    BasicIntegratedString(const CharT* ptr, size_t size):
         ptr_(ptr),
-        size_(utf16_strlen(ptr))
+        size_(packSize(ptr, size))
     {}
 
-    IntegratedString(const char16_t* ptr, size_t size):
+    /*!
+     * Construct line already checked for surrogate pairs, units are not scanned again
+     */
+    BasicIntegratedString(const CharT* ptr, size_t size, bool hasSurrogates):
         ptr_(ptr),
-        size_(size)
+        size_(hasSurrogates ? (size | SURROGATES_FLAG_) : size)
     {}
     
+    /*!
+     * Tell if symbol is service and should be skipped during a sort <br>
+     * All service symbols are ASCII below 64, so one mask is enough
+     */
+    static bool isProhibitedSymbol(CharT sym)
+    {
+        typename std::make_unsigned<CharT>::type unit = sym;
+        return unit < 64 && ((PROHIBITED_MASK_ >> unit) & 1);
+    }
+    
     /*!
      * Emulates string interface of operator []
      * @param index Index of required element
      */
-    char16_t operator [](size_t index) const
+    CharT operator [](size_t index) const
     {
         ASSERT(index < getSize(), "Out of IntegratedString range");
         return ptr_[index];
@@ -251,7 +1000,7 @@ public:
     /*!
      * Constant string getter
      */
-    const char16_t* getPtr() const
+    const CharT* getPtr() const
     {
         return ptr_;
     }
@@ -261,7 +1010,15 @@ public:
      */
     size_t getSize() const
     {
-        return size_;
+        return size_ & ~SURROGATES_FLAG_;
+    }
+
+    /*!
+     * Tells if line has surrogate pairs and is compared by code points
+     */
+    bool hasSurrogates() const
+    {
+        return size_ & SURROGATES_FLAG_;
     }
     
     /*!
@@ -276,7 +1033,7 @@ public:
      * Forward comparison operator
      * @see directionalCompare
      */
-    bool operator <(const IntegratedString& that) const
+    bool operator <(const BasicIntegratedString& that) const
     {
         return directionalCompare(that);       
     }
@@ -285,36 +1042,214 @@ public:
      * Backward comparator
      * @see directionalCompare
      */
-    bool compareReversed(const IntegratedString& that) const
+    bool compareReversed(const BasicIntegratedString& that) const
     {
         return directionalCompare(that, getSize() - 1, that.getSize() - 1, -1);
     }
+
+    /*!
+     * First units of line in the order of comparators packed into one number, <br>
+     * service symbols are skipped and missing units are zeros. Backward UTF-8 key <br>
+     * has code points from the end, each with its bytes in forward order <br>
+     * Lines without surrogate pairs with different keys compare as their keys
+     * @param reversed Whether units are taken from the end, as compareReversed does
+     */
+    uint64_t getPrefixKey(bool reversed = false) const
+    {
+        typedef typename std::make_unsigned<CharT>::type Unit;
+        const unsigned UNIT_BITS = 8 * sizeof(CharT);
+
+        uint64_t key = 0;
+        unsigned filled = 0;
+
+        for (size_t i = 0; i < getSize() && filled < 64; )
+        {
+            CharT unit = ptr_[reversed ? getSize() - 1 - i : i];
+            if (isProhibitedSymbol(unit))
+            {
+                ++i;
+                continue;
+            }
+
+            if (sizeof(CharT) == 1 && reversed)
+            {
+                unsigned char encoded[4] = {};
+                unsigned char* end = utf8_encode(Traits::readCodePoint(ptr_, getSize() - 1, getSize(), &i, -1), encoded);
+                for (const unsigned char* byte = encoded; byte != end && filled < 64; ++byte, filled += 8)
+                    key = (key << 8) | *byte;
+                continue;
+            }
+
+            key = (key << UNIT_BITS) | (Unit) unit;
+            filled += UNIT_BITS;
+            ++i;
+        }
+
+        return (filled < 64) ? key << (64 - filled) : key;
+    }
+
+    /*!
+     * Appends bytes which compare by memcmp as line compares by comparators: <br>
+     * code points in the order of comparison, service symbols skipped, <br>
+     * encoded in UTF-8 which keeps order of code points
+     * @param reversed Whether code points are taken from the end, as compareReversed does
+     * @param key Place to append bytes
+     */
+    void appendNormalizedKey(bool reversed, std::vector<unsigned char>* key) const
+    {
+        int direction = reversed ? -1 : 1;
+        size_t start = reversed ? getSize() - 1 : 0;
+        unsigned char encoded[4] = {};
+
+        for (size_t ind = 0; ind < getSize(); )
+        {
+            if (skipProhibited(ptr_, start, &ind, direction))
+                continue;
+
+            // Forward UTF-8 bytes are in code point order already
+            if (sizeof(CharT) == 1 && !reversed)
+            {
+                key->push_back((unsigned char) ptr_[ind++]);
+                continue;
+            }
+
+            uint32_t code = Traits::readCodePoint(ptr_, start, getSize(), &ind, direction);
+            key->insert(key->end(), encoded, utf8_encode(code, encoded));
+        }
+    }
+
+    /*!
+     * Same line in a copy of its buffer, surrogates flag is kept without rescanning
+     * @param from Start of buffer line points to
+     * @param to Start of the copy
+     */
+    BasicIntegratedString relocated(const CharT* from, const CharT* to) const
+    {
+        BasicIntegratedString line = *this;
+        line.ptr_ = to + (ptr_ - from);
+        return line;
+    }
+
+    /*!
+     * Tells if lines are equal for comparators, i.e. differ only in service symbols
+     */
+    bool isEquivalent(const BasicIntegratedString& that) const
+    {
+        return !(*this < that) && !(that < *this);
+    }
+
+    /*!
+     * Hash of line with service symbols skipped, equivalent lines have equal hashes <br>
+     * Units are packed into 64-bit words and every word is mixed at once
+     */
+    uint64_t hashContent() const
+    {
+        typedef typename std::make_unsigned<CharT>::type Unit;
+        const unsigned UNIT_BITS = 8 * sizeof(CharT);
+
+        uint64_t hash = 0x9e3779b97f4a7c15ull;
+        uint64_t word = 0;
+        unsigned filled = 0;
+        size_t nUnits = 0;
+
+        for (size_t i = 0; i < getSize(); ++i)
+        {
+            if (isProhibitedSymbol(ptr_[i]))
+                continue;
+
+            word |= (uint64_t) (Unit) ptr_[i] << filled;
+            filled += UNIT_BITS;
+            ++nUnits;
+
+            if (filled == 64)
+            {
+                hash = mixHash(hash ^ word);
+                word = 0;
+                filled = 0;
+            }
+        }
+
+        return mixHash(hash ^ word ^ (nUnits << 1));
+    }
+
+    /*!
+     * Compares line with a prefix in the order of comparators, service symbols are skipped <br>
+     * Goes by code points, it is meant for lookups rather than for sorting
+     * @param prefix Beginning (or ending) to look for
+     * @param reversed Whether prefix is looked for at the end of line, as compareReversed orders lines
+     * @return Negative if line is less than all lines starting with prefix, <br>
+     *         0 if it starts with prefix, positive if it is greater than all of them
+     */
+    int comparePrefix(const BasicIntegratedString& prefix, bool reversed = false) const
+    {
+        int direction = reversed ? -1 : 1;
+        size_t startLHS = reversed ? getSize() - 1 : 0;
+        size_t startRHS = reversed ? prefix.getSize() - 1 : 0;
+        size_t indLHS = 0, indRHS = 0;
+
+        while (true)
+        {
+            advanceUntilNotProhibited(       ptr_, startLHS,        getSize(), &indLHS, direction);
+            advanceUntilNotProhibited(prefix.ptr_, startRHS, prefix.getSize(), &indRHS, direction);
+
+            if (indRHS >= prefix.getSize())
+                return 0;
+            if (indLHS >= getSize())
+                return -1;
+
+            uint32_t lhs = Traits::readCodePoint(       ptr_, startLHS,        getSize(), &indLHS, direction);
+            uint32_t rhs = Traits::readCodePoint(prefix.ptr_, startRHS, prefix.getSize(), &indRHS, direction);
+
+            if (lhs != rhs)
+                return (lhs < rhs) ? -1 : 1;
+        }
+    }
 };
 
+typedef BasicIntegratedString<char16_t> IntegratedString; //!< Line of UTF-16 text
+typedef BasicIntegratedString<char>     Utf8String;       //!< Line of UTF-8 text
+typedef BasicIntegratedString<char32_t> Utf32String;      //!< Line of UTF-32 text
+
+template <typename CharT>
+class BasicText;
+
 /*!
  * \brief Represents current order of lines
  * In fact closes vector order form user's eye
  */
-class LineOrder
+template <typename CharT>
+class BasicLineOrder
 {
-    friend class Text;
+    friend class BasicText<CharT>;
 
     private:
-        std::vector<IntegratedString> lines_;
+        std::vector<BasicIntegratedString<CharT>> lines_;
 
-        LineOrder(size_t nLines, IntegratedString* strings_):
+        BasicLineOrder(size_t nLines, BasicIntegratedString<CharT>* strings_):
             lines_(strings_, strings_ + nLines)
         {}
 };
 
+typedef BasicLineOrder<char16_t> LineOrder; //!< Order of UTF-16 text lines
+
 /*!
- * Backward comparator in a form of not-a-member function
- * @see IntegratedString::compareReversed(that)
+ * \brief Backward comparator in a form of not-a-member function object
+ * Works for lines of every code unit type
+ * @see BasicIntegratedString::compareReversed(that)
  */
-bool reverseStringComparator(const IntegratedString& lhs, const IntegratedString& rhs)
+struct ReverseStringComparator
 {
-    return lhs.compareReversed(rhs);
-}
+    template <typename CharT>
+    bool operator ()(const BasicIntegratedString<CharT>& lhs, const BasicIntegratedString<CharT>& rhs) const
+    {
+        return lhs.compareReversed(rhs);
+    }
+};
+
+/*!
+ * Backward comparator to pass to BasicText::sort
+ */
+const ReverseStringComparator reverseStringComparator = {};
 
 /*!
  * \brief Class to represent text from file
@@ -322,79 +1257,276 @@ bool reverseStringComparator(const IntegratedString& lhs, const IntegratedString
  *
  * Implementation for working with file as a whole buffer <br>
  * Provides interface for working with file order
+ * @tparam CharT Code unit: char16_t for UTF-16, char for UTF-8 sorted directly, char32_t for UTF-32
  */
-class Text
+template <typename CharT>
+class BasicText
 {
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of lines
+    typedef BasicLineOrder<CharT>        Order;  //!< Type of saved orders
+    typedef std::pair<size_t, size_t>    Range;  //!< Half-open range of positions in current order
+
 private:
-    char16_t* buffer_; //!> Place to read a whole file
+    typedef CodeUnitTraits<CharT> Traits;
+
+    CharT* buffer_;    //!> Place to read a whole file
     size_t nSymbols_;  //!> File size in symbols
     size_t nLines_;    //!> Number of lines in file
+    size_t nHeader_;   //!> Number of symbols before the first line (byte order mark)
+
+    String* strings_;  //!> Current order of lines
+    String* original_; //!> Original order not to be killed
+
+    static const size_t PARTIAL_SORT_HEAP_RATIO_ = 16; //!> Fraction of lines below which heap selection is used
+
+    bool hugePages_;               //!> Whether to back arrays with 2 MB pages
+    bool asyncIO_;                 //!> Whether to read with io_uring
+    TextEncoding inputEncoding_;   //!> Encoding of files to load
+    TextEncoding outputEncoding_;  //!> Encoding to print in, if it is not native one only UTF-8 is supported
+    bool isPrepared_;              //!> Whether read buffer is brought to native byte order already
+    std::vector<char> rawBytes_;   //!> Place for UTF-8 file before conversion
+    size_t bufferCapacity_;        //!> Number of symbols buffer_ was allocated for
+    size_t linesCapacity_;         //!> Number of lines strings_ and original_ were allocated for
+    PageBacking bufferBacking_;    //!> Pages obtained for buffer_
+    PageBacking stringsBacking_;   //!> Pages obtained for strings_
+    PageBacking originalBacking_;  //!> Pages obtained for original_
+
+    /*!
+     * Prepares buffer_ for given number of symbols and two terminating zeros <br>
+     * Memory of previous load is reused if it is large enough
+     */
+    void allocateBuffer(size_t nSymbols)
+    {
+        if (nSymbols + 2 > bufferCapacity_)
+        {
+            freeArray(buffer_, bufferCapacity_, bufferBacking_);
+            bufferCapacity_ = nSymbols + 2;
+            buffer_ = allocateArray<CharT>(bufferCapacity_, hugePages_, &bufferBacking_);
+        }
+
+        buffer_[nSymbols] = buffer_[nSymbols + 1] = CharT(0);
+    }
+
+    /*!
+     * Prepares strings_ for given number of lines <br>
+     * Memory of previous load is reused if it is large enough
+     */
+    void allocateLines(size_t nLines)
+    {
+        if (nLines <= linesCapacity_)
+            return;
+
+        freeArray(strings_,  linesCapacity_, stringsBacking_);
+        freeArray(original_, linesCapacity_, originalBacking_);
+        original_ = nullptr;
+
+        linesCapacity_ = nLines;
+        strings_ = allocateArray<String>(linesCapacity_, hugePages_, &stringsBacking_);
+    }
+
+    /*!
+     * Frees all arrays owned by text
+     */
+    void releaseMemory()
+    {
+        freeArray(buffer_,   bufferCapacity_, bufferBacking_);
+        freeArray(strings_,  linesCapacity_,  stringsBacking_);
+        freeArray(original_, linesCapacity_,  originalBacking_);
+
+        buffer_   = nullptr;
+        strings_  = nullptr;
+        original_ = nullptr;
+        bufferCapacity_ = linesCapacity_ = 0;
+    }
+    
+    /*!
+     * Open file and read to already created buffer
+     */
+    bool readFile(const char* filename)
+    {
+        if (asyncIO_)
+        {
+            ASSERT(buffer_, "Invalid buffer before reading");
+            return readFileChunked(filename, buffer_, nSymbols_ * sizeof(CharT), threadIoRing());
+        }
+
+        FILE* sourceFile = fopen(filename, "r");
+        if (!sourceFile)
+            return false;
+
+        ASSERT(buffer_, "Invalid buffer before reading");
+        size_t symbolsRead = fread(buffer_, sizeof(CharT), nSymbols_, sourceFile);
+        fclose(sourceFile);
+        return symbolsRead == nSymbols_;
+    }
+    
+    /*!
+     * Reads UTF-8 file and converts it to buffer of native code units <br>
+     * Buffer gets byte order mark at the beginning like a file in UTF-16
+     * @return false if file can not be read, empty file is read fine
+     */
+    bool readUtf8File(const char* filename)
+    {
+        size_t nBytes = getFileBytesNumber(filename);
+        rawBytes_.resize(nBytes);
+
+        // File is opened even if it looks empty: size of missing file is 0 as well
+        IoRing* ring = asyncIO_ ? threadIoRing() : nullptr;
+        if (!readFileChunked(filename, rawBytes_.data(), nBytes, ring))
+            return false;
+
+        const char* bytes = rawBytes_.data();
+        if (nBytes >= 3 && memcmp(bytes, "\xef\xbb\xbf", 3) == 0)
+        {
+            bytes  += 3;
+            nBytes -= 3;
+        }
+
+        allocateBuffer(nBytes + 1);
+        buffer_[0] = CharT(UTF16_BOM);
+        nSymbols_ = 1 + convertFromUtf8(bytes, nBytes, buffer_ + 1);
+        buffer_[nSymbols_] = buffer_[nSymbols_ + 1] = CharT(0);
+        return true;
+    }
+
+    /*!
+     * Converts lines in current order to output encoding
+     * @param maxLines Number of first lines to convert
+     * @see appendEncoded
+     */
+    std::string encodeOutput(size_t maxLines) const
+    {
+        const CharT newline = CharT('\n');
+        std::string result;
+        result.reserve(nSymbols_ * sizeof(CharT));
+
+        appendEncodedHeader(&result);
+        for (size_t i = 0; i < std::min(nLines_, maxLines); ++i)
+        {
+            appendEncoded(strings_[i].getPtr(), strings_[i].getSize(), &result);
+            appendEncoded(&newline, 1, &result);
+        }
+
+        return result;
+    }
+
+    /*!
+     * Separates buffer into lines <br>/
+     * Stores result in a form of InegratedString array
+     */
+    void separateBufferIntoLines(size_t needStartSymbol = 1)
+    {
+        nHeader_ = needStartSymbol;
+        CharT* end = buffer_ + nSymbols_;
+        nLines_ = unit_count<CharT>(buffer_ + needStartSymbol, end, CharT('\n')) + 1;
+        allocateLines(nLines_);
+
+        splitRange(buffer_ + needStartSymbol, end, strings_);
+    }
+
+    /*!
+     * Writes lines of part of buffer to array, newlines are replaced with zeros
+     * @param begin, end Part of buffer
+     * @param lines Place for number of newlines plus one lines
+     */
+    static void splitRange(CharT* begin, CharT* end, String* lines)
+    {
+        size_t currLine = 0;
+        CharT* currBeginning = begin;
+
+        for (CharT* newline = (CharT*) unit_find<CharT>(currBeginning, end, CharT('\n')); newline != end;
+             newline = (CharT*) unit_find<CharT>(currBeginning, end, CharT('\n')))
+        {
+            lines[currLine++] = String(currBeginning, newline - currBeginning);
+            *newline = CharT(0);
+            currBeginning = newline + 1;
+        }
+
+        lines[currLine] = String(currBeginning, end - currBeginning);
+    }
+
+    /*!
+     * Enlarges buffer_ keeping its symbols and moves lines to the new place <br>
+     * Capacity grows at least twice, so repeated appends cost amortized linear time
+     */
+    void growBuffer(size_t nSymbols)
+    {
+        if (nSymbols + 2 <= bufferCapacity_)
+            return;
+
+        size_t capacity = std::max(nSymbols + 2, 2 * bufferCapacity_);
+        PageBacking backing = PAGES_HEAP;
+        CharT* buffer = allocateArray<CharT>(capacity, hugePages_, &backing);
+        memcpy(buffer, buffer_, nSymbols_ * sizeof(CharT));
+
+        for (size_t i = 0; i < nLines_; ++i)
+        {
+            strings_[i]  = strings_[i].relocated(buffer_, buffer);
+            original_[i] = original_[i].relocated(buffer_, buffer);
+        }
+
+        freeArray(buffer_, bufferCapacity_, bufferBacking_);
+        buffer_ = buffer;
+        bufferCapacity_ = capacity;
+        bufferBacking_ = backing;
+    }
 
-    IntegratedString* strings_;  //!> Current order of lines
-    IntegratedString* original_; //!> Original order not to be killed
-    
     /*!
-     * Open file and read to already created buffer
+     * Enlarges strings_ and original_ keeping current and original orders
      */
-    bool readFile(const char* filename)
+    void growLines(size_t nLines)
     {
-        FILE* sourceFile = fopen(filename, "r");
-        if (!sourceFile)
-            return false;
+        if (nLines <= linesCapacity_)
+            return;
 
-        ASSERT(buffer_, "Invalid buffer before reading");
-        size_t symbolsRead = fread(buffer_, sizeof(char16_t), nSymbols_, sourceFile);
-        fclose(sourceFile);
-        return symbolsRead == nSymbols_;
+        size_t capacity = std::max(nLines, 2 * linesCapacity_);
+        PageBacking stringsBacking = PAGES_HEAP, originalBacking = PAGES_HEAP;
+        String* strings  = allocateArray<String>(capacity, hugePages_, &stringsBacking);
+        String* original = allocateArray<String>(capacity, hugePages_, &originalBacking);
+        memcpy(strings,  strings_,  nLines_ * sizeof(String));
+        memcpy(original, original_, nLines_ * sizeof(String));
+
+        freeArray(strings_,  linesCapacity_, stringsBacking_);
+        freeArray(original_, linesCapacity_, originalBacking_);
+
+        strings_  = strings;
+        original_ = original;
+        linesCapacity_  = capacity;
+        stringsBacking_ = stringsBacking;
+        originalBacking_ = originalBacking;
     }
     
     /*!
-     * Separates buffer into lines <br>/
-     * Stores result in a form of InegratedString array
+     * Brings read buffer to native byte order, only the first call after reading changes it, <br>
+     * so splitLines may follow assignLines which failed
+     * @return Number of symbols before the first line
      */
-    void separateBufferIntoLines(int needStartSymbol = 1)
+    size_t prepareBuffer()
     {
-        nLines_ = utf16_count(buffer_, L'\n') + 1;
-        strings_ = new IntegratedString[nLines_];
-        
-        size_t currLength = 0;
-        size_t currLine = 0;
-        char16_t* currBeginning = buffer_ + needStartSymbol;
-        
-        
-        for (size_t i = needStartSymbol; i < nSymbols_; ++i)
+        if (!isPrepared_)
         {
-            if (buffer_[i] != L'\n')
-            {
-                ++currLength;
-            }
-            else
-            {
-                strings_[currLine] = IntegratedString(currBeginning, currLength);
-                currBeginning = buffer_ + i + 1;
-                currLength = 0;
-                ++currLine;
-                buffer_[i] = L'\0';
-            }
+            nHeader_ = Traits::prepareBuffer(buffer_, nSymbols_, inputEncoding_);
+            isPrepared_ = true;
         }
 
-        strings_[currLine] = IntegratedString(currBeginning, currLength);
+        return nHeader_;
     }
-    
+
     /*!
      * Removes blank lines from the end
      */
     void shrinkEmptyLines()
     {
-        while (strings_[nLines_ - 1].getSize() == 0 && nLines_ > 0)
+        while (nLines_ > 0 && strings_[nLines_ - 1].getSize() == 0)
             --nLines_;
     }
     
-    Text(const Text& that)                   = delete;
-    const Text& operator =(const Text& that) = delete;
+    BasicText(const BasicText& that)                   = delete;
+    const BasicText& operator =(const BasicText& that) = delete;
 
 protected:
-    IntegratedString* __getUnsafeOrder()
+    String* __getUnsafeOrder()
     {
         return strings_;
     }
@@ -405,85 +1537,198 @@ public:
      */
     void setOriginal()
     {
-        original_ = new IntegratedString[nLines_];
-        memcpy(original_, strings_, nLines_ * sizeof(IntegratedString));
+        if (!original_)
+            original_ = allocateArray<String>(linesCapacity_, hugePages_, &originalBacking_);
+        memcpy(original_, strings_, nLines_ * sizeof(String));
     }
     
     /*!
      * Reads file in buffer <br>
-     * Then separates it into lines and stores inside a Text-object
+     * Then separates it into lines and stores inside a Text-object <br>
+     * May be called again for another file, memory is then reused
      * @param filename Path to a file to read
      */
     void loadFromFile(const char* filename)
     {
-        nSymbols_ = utf16_file_len(filename);
-        buffer_ = new char16_t[nSymbols_ + 2];
-        
-        if (!readFile(filename))
+        if (!readRawFromFile(filename))
         {
             fprintf(stderr, "Unable to read file: %s\n", filename);
             assert(false);
         }
 
-        separateBufferIntoLines();
+        splitLines();
+    }
+
+    /*!
+     * First half of loadFromFile: only reads file in buffer <br>
+     * Lets reading and parsing of different files go in different threads
+     * @param filename Path to a file to read
+     * @return false if file can not be read
+     * @see splitLines
+     */
+    bool readRawFromFile(const char* filename)
+    {
+        isPrepared_ = false;
+        if (inputEncoding_ == ENCODING_UTF8 && Traits::ENCODING != ENCODING_UTF8)
+            return readUtf8File(filename);
+
+        nSymbols_ = getFileBytesNumber(filename) / sizeof(CharT);
+        allocateBuffer(nSymbols_);
+        return readFile(filename);
+    }
+
+    /*!
+     * Second half of loadFromFile: separates read buffer into lines <br>
+     * Buffer of other byte order is swapped to native one first
+     * @see readRawFromFile
+     */
+    void splitLines()
+    {
+        separateBufferIntoLines(prepareBuffer());
         shrinkEmptyLines();
         setOriginal();
     }
     
+    /*!
+     * Second half of loadFromFile for lines known in advance, e.g. from an index file <br>
+     * Buffer is not scanned for newlines, only byte order is fixed
+     * @param nHeader Number of symbols before the first line
+     * @param nLines Number of lines
+     * @param offsets, sizes First symbol and length of every line in original order
+     * @return false if lines do not fit the read buffer
+     * @see readRawFromFile
+     */
+    bool assignLines(size_t nHeader, size_t nLines, const uint32_t* offsets, const uint32_t* sizes)
+    {
+        if (prepareBuffer() != nHeader || nLines == 0)
+            return false;
+
+        for (size_t i = 0; i < nLines; ++i)
+            if (offsets[i] < nHeader || (size_t) offsets[i] + sizes[i] > nSymbols_)
+                return false;
+
+        nHeader_ = nHeader;
+        nLines_  = nLines;
+        allocateLines(nLines_);
+
+        for (size_t i = 0; i < nLines_; ++i)
+        {
+            strings_[i] = String(buffer_ + offsets[i], sizes[i]);
+            if (offsets[i] + sizes[i] < nSymbols_)
+                buffer_[offsets[i] + sizes[i]] = CharT(0);
+        }
+
+        setOriginal();
+        return true;
+    }
+
     /*!
      * Copies buffer to store the same information <br>
      * Separates into lines
      * @param buf Buffer to copy
      * @param size Number of symbols to copy, -1 for the whole buffer
      */ 
-    void loadFromBuffer(const char16_t* buf, int size = -1)
+    void loadFromBuffer(const CharT* buf, int size = -1)
     {
         if (size < 0)
-            nSymbols_ = utf16_strlen(buf);
+            nSymbols_ = unit_strlen(buf);
         else
             nSymbols_ = size;
 
-        buffer_ = new char16_t[nSymbols_ + 2];
-        memcpy(buffer_, buf, nSymbols_ * sizeof(char16_t));
+        allocateBuffer(nSymbols_);
+        memcpy(buffer_, buf, nSymbols_ * sizeof(CharT));
         separateBufferIntoLines(0);
         setOriginal();
     }
     
-    Text():
+    BasicText():
         buffer_(nullptr),
         nSymbols_(0),
         nLines_(0),
-        strings_(nullptr)
+        nHeader_(0),
+        strings_(nullptr),
+        original_(nullptr),
+        hugePages_(false),
+        asyncIO_(false),
+        inputEncoding_(ENCODING_UTF16),
+        outputEncoding_(ENCODING_UTF16),
+        isPrepared_(false),
+        bufferCapacity_(0),
+        linesCapacity_(0),
+        bufferBacking_(PAGES_HEAP),
+        stringsBacking_(PAGES_HEAP),
+        originalBacking_(PAGES_HEAP)
     {}
 
     /*!
      * Main constructor. <br>
      * Reads whole file and structurizes it
+     * @param filename Path to a file to read
+     * @param hugePages Whether to back arrays with 2 MB pages
+     * @see useHugePages
      */
-    Text(const char* filename):
-        Text()
+    BasicText(const char* filename, bool hugePages = false):
+        BasicText()
     {
+        useHugePages(hugePages);
         loadFromFile(filename);
     }
 
     /*!
      * Prints contents in current order to provided file line by line
      * @param output File to print in
+     * @param maxLines Number of first lines to print, all by default
      */
-    void printToFile(FILE* output) const
+    void printToFile(FILE* output, size_t maxLines = SIZE_MAX) const
     {
         ASSERT(output, "Invalid output file");
         ASSERT(!ferror(output), "Corrupted output file");
 
-        fwrite(buffer_, sizeof(char16_t), 1, output);
+        if (isTranscodingOutput())
+        {
+            std::string encoded = encodeOutput(maxLines);
+            fwrite(encoded.data(), 1, encoded.size(), output);
+            return;
+        }
 
-        for (size_t i = 0; i < nLines_; ++i)
+        const CharT newline = CharT('\n');
+        fwrite(buffer_, sizeof(CharT), nHeader_, output);
+
+        for (size_t i = 0; i < std::min(nLines_, maxLines); ++i)
         {
-            fwrite(strings_[i].getPtr(), sizeof(char16_t), strings_[i].getSize(), output); 
-            fwrite(&UTF16_NEWLINE, sizeof(char16_t), 1, output);
+            fwrite(strings_[i].getPtr(), sizeof(CharT), strings_[i].getSize(), output); 
+            fwrite(&newline, sizeof(CharT), 1, output);
         }
     }
     
+    /*!
+     * Adds contents in current order to batch of asynchronous output <br>
+     * Batch keeps pointers into the buffer, so text must outlive writing, <br>
+     * but lines may be reordered after the call
+     * @param batch Output to add to
+     * @param maxLines Number of first lines to add, all by default
+     * @see printToFile
+     */
+    void collectOutput(OutputBatch* batch, size_t maxLines = SIZE_MAX) const
+    {
+        assert(batch);
+
+        if (isTranscodingOutput())
+        {
+            batch->addOwned(encodeOutput(maxLines));
+            return;
+        }
+
+        static const CharT newline = CharT('\n');
+        batch->add(buffer_, nHeader_ * sizeof(CharT));
+
+        for (size_t i = 0; i < std::min(nLines_, maxLines); ++i)
+        {
+            batch->add(strings_[i].getPtr(), strings_[i].getSize() * sizeof(CharT));
+            batch->add(&newline, sizeof(CharT));
+        }
+    }
+
     /*!
      * Checks pointers for correctness
      */
@@ -497,69 +1742,476 @@ public:
      * @param index Index of line required
      * @return Constant reference to line
      */ 
-    const IntegratedString& operator [](size_t index) const
+    const String& operator [](size_t index) const
     {
         ASSERT(index < nLines_, "Out of text lines range");
         return strings_[index];
     }
 
     /*!
-     * Sorts lines in text with std::sort
+     * Sorts lines in text with std::sort <br>
+     * If a quick sample finds long presorted runs, they are merged by adaptiveSort instead
+     * @tparam Comparator - Comparator type for IntegratedStrings
+     * @param comp - given type comparator
+     */
+    template <typename Comparator = std::less<String>>
+    void sort(Comparator comp = std::less<String>())
+    {
+        if (looksPresorted(strings_, strings_ + nLines_, comp))
+            adaptiveSort(strings_, strings_ + nLines_, comp);
+        else
+            std::sort(strings_, strings_ + nLines_, comp);
+    }
+
+    /*!
+     * Stable sort by forward or backward comparator: equivalent lines keep their current order <br>
+     * Lines are merge sorted together with 64-bit keys of their first units, <br>
+     * so most comparisons do not touch lines at all. If only k first lines are asked, <br>
+     * they are selected by sortFirst with current position breaking ties
+     * @param reversed Whether to sort by line endings
+     * @param k Number of first lines to sort, the rest are left in unspecified order
+     * @see String::getPrefixKey, adaptiveSort
+     */
+    void stableSort(bool reversed = false, size_t k = SIZE_MAX)
+    {
+        struct KeyedLine
+        {
+            uint64_t key;
+            String line;
+        };
+
+        std::vector<KeyedLine> keyed(nLines_);
+        for (size_t i = 0; i < nLines_; ++i)
+            keyed[i] = {strings_[i].getPrefixKey(reversed), strings_[i]};
+
+        auto isLess = [reversed](const KeyedLine& lhs, const KeyedLine& rhs)
+        {
+            if (lhs.key != rhs.key && !lhs.line.hasSurrogates() && !rhs.line.hasSurrogates())
+                return lhs.key < rhs.key;
+
+            return reversed ? lhs.line.compareReversed(rhs.line) : lhs.line < rhs.line;
+        };
+
+        if (k < nLines_)
+        {
+            std::vector<uint32_t> order(nLines_);
+            for (size_t i = 0; i < nLines_; ++i)
+                order[i] = i;
+
+            sortFirst(order.begin(), order.end(), k, [&keyed, &isLess](uint32_t lhs, uint32_t rhs)
+            {
+                if (isLess(keyed[lhs], keyed[rhs]))
+                    return true;
+                return !isLess(keyed[rhs], keyed[lhs]) && lhs < rhs;
+            });
+
+            for (size_t i = 0; i < nLines_; ++i)
+                strings_[i] = keyed[order[i]].line;
+            return;
+        }
+
+        adaptiveSort(keyed.begin(), keyed.end(), isLess);
+
+        for (size_t i = 0; i < nLines_; ++i)
+            strings_[i] = keyed[i].line;
+    }
+
+    /*!
+     * Puts k least elements of range to its beginning in sorted order <br>
+     * Small k use heap selection in O(n log k), large k use nth_element and sort of prefix
+     */
+    template <typename Iterator, typename Comparator>
+    static void sortFirst(Iterator first, Iterator last, size_t k, Comparator comp)
+    {
+        size_t size = last - first;
+
+        if (k >= size)
+            std::sort(first, last, comp);
+        else if (k <= size / PARTIAL_SORT_HEAP_RATIO_)
+            std::partial_sort(first, first + k, last, comp);
+        else
+        {
+            std::nth_element(first, first + k, last, comp);
+            std::sort(first, first + k, comp);
+        }
+    }
+
+    /*!
+     * Puts k least lines to the beginning in sorted order <br>
+     * Order of the rest lines is unspecified <br>
+     * Small k use heap selection in O(n log k), large k use nth_element and sort of prefix
      * @tparam Comparator - Comparator type for IntegratedStrings
+     * @param k - number of lines wanted
      * @param comp - given type comparator
      */
-    template <typename Comparator = std::less<IntegratedString>>
-    void sort(Comparator comp = std::less<IntegratedString>())
+    template <typename Comparator = std::less<String>>
+    void partialSort(size_t k, Comparator comp = std::less<String>())
+    {
+        sortFirst(strings_, strings_ + nLines_, k, comp);
+    }
+
+    /*!
+     * Sorts lines by comparator of their indices in original order, e.g. one keeping <br>
+     * keys precomputed for original lines. Indices are found once before sorting, <br>
+     * so comparator never looks at lines. Equivalent lines keep original order
+     * @param comp Strict weak order of original indices
+     * @param k Number of first lines to sort, the rest are left in unspecified order
+     */
+    template <typename IndexComparator>
+    void sortByIndices(IndexComparator comp, size_t k = SIZE_MAX)
+    {
+        std::vector<uint32_t> order(nLines_);
+        getPermutation(order.data());
+
+        sortFirst(order.begin(), order.end(), k, [&comp](uint32_t lhs, uint32_t rhs)
+        {
+            if (comp(lhs, rhs))
+                return true;
+            return !comp(rhs, lhs) && lhs < rhs;
+        });
+
+        setPermutation(order.data());
+    }
+
+    /*!
+     * Sorts lines by keys precomputed for them <br>
+     * Keys are compared as byte strings, lines themselves are not looked at <br>
+     * Lines with equal keys keep their current order
+     * @param keys Arena with key of i-th line of current order at index i
+     * @param k Number of first lines to sort, the rest are left in unspecified order
+     * @see SortKeyArena
+     */
+    void sortByKeys(const SortKeyArena& keys, size_t k = SIZE_MAX)
     {
-        std::sort(strings_, strings_ + nLines_, comp);
+        ASSERT(keys.size() == nLines_, "Number of keys differs from number of lines");
+
+        std::vector<size_t> order(nLines_);
+        for (size_t i = 0; i < nLines_; ++i)
+            order[i] = i;
+
+        sortFirst(order.begin(), order.end(), k, [&keys](size_t lhs, size_t rhs)
+        {
+            int result = keys.compare(lhs, rhs);
+            return result < 0 || (result == 0 && lhs < rhs);
+        });
+
+        std::vector<String> sorted(nLines_);
+        for (size_t i = 0; i < nLines_; ++i)
+            sorted[i] = strings_[order[i]];
+
+        std::copy(sorted.begin(), sorted.end(), strings_);
     }
     
+    /*!
+     * Adds lines to the end of loaded text, only new lines are sorted <br>
+     * They are merged into current order in linear time, original order gets them at the end <br>
+     * Buffer may move, so orders saved by getOrder become invalid
+     * @param buf Symbols of new lines in native byte order, without byte order mark
+     * @param size Number of symbols
+     * @param comp Comparator current order is sorted by
+     */
+    template <typename Comparator = std::less<String>>
+    void append(const CharT* buf, size_t size, Comparator comp = Comparator())
+    {
+        assert(isOk());
+
+        size_t begin = nSymbols_ + 1;
+        growBuffer(begin + size);
+
+        buffer_[nSymbols_] = CharT(0);
+        memcpy(buffer_ + begin, buf, size * sizeof(CharT));
+        nSymbols_ = begin + size;
+        buffer_[nSymbols_] = buffer_[nSymbols_ + 1] = CharT(0);
+
+        CharT* end = buffer_ + nSymbols_;
+        size_t nNew = unit_count<CharT>(buffer_ + begin, end, CharT('\n')) + 1;
+        growLines(nLines_ + nNew);
+        splitRange(buffer_ + begin, end, original_ + nLines_);
+
+        while (nNew > 0 && original_[nLines_ + nNew - 1].getSize() == 0)
+            --nNew;
+
+        String* first = strings_ + nLines_;
+        memcpy(first, original_ + nLines_, nNew * sizeof(String));
+        std::sort(first, first + nNew, comp);
+        std::inplace_merge(strings_, first, first + nNew, comp);
+
+        nLines_ += nNew;
+    }
+
+    /*!
+     * Leaves only the first of equivalent lines in original order, in one hashing pass <br>
+     * Current order becomes the original one
+     * @param counts If not nullptr, gets number of occurrences of every remaining line
+     * @return Number of removed lines
+     * @see String::isEquivalent
+     */
+    size_t removeDuplicates(std::vector<uint32_t>* counts = nullptr)
+    {
+        static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+        size_t nSlots = 1;
+        while (nSlots < 2 * nLines_)
+            nSlots *= 2;
+
+        std::vector<uint32_t> slots(nSlots, EMPTY_SLOT);
+        std::vector<uint64_t> hashes(nLines_);
+        if (counts)
+            counts->clear();
+
+        size_t nKept = 0;
+        for (size_t i = 0; i < nLines_; ++i)
+        {
+            uint64_t hash = original_[i].hashContent();
+            size_t slot = hash & (nSlots - 1);
+
+            while (slots[slot] != EMPTY_SLOT &&
+                   !(hashes[slots[slot]] == hash && original_[slots[slot]].isEquivalent(original_[i])))
+            {
+                slot = (slot + 1) & (nSlots - 1);
+            }
+
+            if (slots[slot] != EMPTY_SLOT)
+            {
+                if (counts)
+                    ++(*counts)[slots[slot]];
+                continue;
+            }
+
+            slots[slot] = nKept;
+            hashes[nKept] = hash;
+            original_[nKept++] = original_[i];
+            if (counts)
+                counts->push_back(1);
+        }
+
+        size_t nRemoved = nLines_ - nKept;
+        nLines_ = nKept;
+        recoverOriginal();
+        return nRemoved;
+    }
+
+    /*!
+     * Position of the first line not less than key <br>
+     * Text must be sorted in the same direction by comparators of lines
+     * @param key Line to look for
+     * @param reversed Whether text is sorted by line endings
+     */
+    size_t lowerBound(const String& key, bool reversed = false) const
+    {
+        if (reversed)
+            return std::lower_bound(strings_, strings_ + nLines_, key, reverseStringComparator) - strings_;
+        return std::lower_bound(strings_, strings_ + nLines_, key) - strings_;
+    }
+
+    /*!
+     * Position of the first line greater than key
+     * @see lowerBound
+     */
+    size_t upperBound(const String& key, bool reversed = false) const
+    {
+        if (reversed)
+            return std::upper_bound(strings_, strings_ + nLines_, key, reverseStringComparator) - strings_;
+        return std::upper_bound(strings_, strings_ + nLines_, key) - strings_;
+    }
+
+    /*!
+     * Lines equal to key, service symbols are not taken into account
+     * @return Half-open range of positions in current order
+     * @see lowerBound
+     */
+    Range equalRange(const String& key, bool reversed = false) const
+    {
+        return Range(lowerBound(key, reversed), upperBound(key, reversed));
+    }
+
+    /*!
+     * Lines starting with prefix, or ending with it if text is sorted by endings
+     * @param prefix Beginning (or ending) of lines to look for
+     * @param reversed Whether text is sorted by line endings
+     * @return Half-open range of positions in current order
+     * @see String::comparePrefix, lowerBound
+     */
+    Range prefixRange(const String& prefix, bool reversed = false) const
+    {
+        const String* first = std::partition_point(strings_, strings_ + nLines_, [&](const String& line)
+        {
+            return line.comparePrefix(prefix, reversed) < 0;
+        });
+
+        const String* last = std::partition_point(first, (const String*) strings_ + nLines_, [&](const String& line)
+        {
+            return line.comparePrefix(prefix, reversed) == 0;
+        });
+
+        return Range(first - strings_, last - strings_);
+    }
+
     /*!
      * @return Current line order for futher usage
      */
-    LineOrder getOrder() const
+    Order getOrder() const
     {
-        return LineOrder(nLines_, strings_);
+        return Order(nLines_, strings_);
     }
     
     /*!
      * Set previously saved line order
      */
-    void setOrder(const LineOrder& order)
+    void setOrder(const Order& order)
     {
         ASSERT(order.lines_.size() == nLines_, "Passed order has another number of lines");
-        memcpy(strings_, order.lines_.data(), nLines_ * sizeof(IntegratedString));
+        memcpy(strings_, order.lines_.data(), nLines_ * sizeof(String));
     }
     
+    /*!
+     * Writes current order as indices of lines in original order
+     * @param order Array of getNLines() elements to fill
+     */
+    void getPermutation(uint32_t* order) const
+    {
+        for (size_t i = 0; i < nLines_; ++i)
+            order[i] = std::lower_bound(original_, original_ + nLines_, strings_[i],
+                                        [](const String& lhs, const String& rhs)
+                                        {
+                                            return lhs.getPtr() < rhs.getPtr();
+                                        }) - original_;
+    }
+
+    /*!
+     * Sets order given as indices of lines in original order
+     * @param order Array of getNLines() indices, e.g. written by getPermutation
+     */
+    void setPermutation(const uint32_t* order)
+    {
+        for (size_t i = 0; i < nLines_; ++i)
+        {
+            ASSERT(order[i] < nLines_, "Permutation refers to absent line");
+            strings_[i] = original_[order[i]];
+        }
+    }
+
+    /*!
+     * Number of symbols before the first line
+     */
+    size_t getNHeader() const { return nHeader_; }
+
     /*!
      * Returns current line order to the original one
      */
     void recoverOriginal()
     {
-        memcpy(strings_, original_, nLines_ * sizeof(IntegratedString));
+        memcpy(strings_, original_, nLines_ * sizeof(String));
     }
 
-    size_t getNLines()   const { return nLines_; }
-    size_t getNSymbols() const { return nSymbols_; }
+    /*!
+     * Whether printing converts lines: to UTF-8 or to big-endian UTF-16
+     */
+    bool isTranscodingOutput() const
+    {
+        return (outputEncoding_ == ENCODING_UTF8 && Traits::ENCODING != ENCODING_UTF8) ||
+               outputEncoding_ == ENCODING_UTF16BE;
+    }
 
-    ~Text()
+    /*!
+     * Appends units converted to output encoding, for texts with isTranscodingOutput()
+     * @param units, size Units to convert
+     * @param encoded Place to append bytes
+     */
+    void appendEncoded(const CharT* units, size_t size, std::string* encoded) const
     {
-        if (buffer_)
-        {
-            delete[] buffer_;
-            buffer_ = nullptr;
-        }
-        
-        if (original_)
+        if (outputEncoding_ != ENCODING_UTF16BE)
         {
-            delete[] original_;
-            original_ = nullptr;
+            appendAsUtf8(units, size, encoded);
+            return;
         }
 
-        if (strings_)
+        // setEncodings allows big-endian output only for UTF-16 units, so nothing is narrowed
+        for (size_t i = 0; i < size; ++i)
         {
-            delete[] strings_;
-            strings_ = nullptr;
+            char16_t unit = units[i];
+            encoded->push_back((char) (unit >> 8));
+            encoded->push_back((char) unit);
         }
     }
+
+    /*!
+     * Appends symbols before the first line converted to output encoding, <br>
+     * UTF-8 output is written without byte order mark
+     * @param encoded Place to append bytes
+     */
+    void appendEncodedHeader(std::string* encoded) const
+    {
+        if (outputEncoding_ == ENCODING_UTF16BE)
+            appendEncoded(buffer_, nHeader_, encoded);
+    }
+
+    size_t getNLines()   const { return nLines_; }
+    size_t getNSymbols() const { return nSymbols_; }
+
+    /*!
+     * Whole loaded file, lines are parts of it
+     */
+    const CharT* getBuffer() const { return buffer_; }
+
+    /*!
+     * Asks to back buffer and line arrays with 2 MB pages <br>
+     * Random accesses during sort then miss TLB much more rarely <br>
+     * Takes effect on the next load
+     * @param enable Whether huge pages are wanted
+     */
+    void useHugePages(bool enable = true)
+    {
+        hugePages_ = enable;
+    }
+
+    /*!
+     * Asks to read files with chunked io_uring requests <br>
+     * Plain preadv is used if kernel has no io_uring
+     * @param enable Whether asynchronous reading is wanted
+     */
+    void useAsyncIO(bool enable = true)
+    {
+        asyncIO_ = enable;
+    }
+
+    /*!
+     * Chooses encodings of files <br>
+     * UTF-8 input is converted to UTF-16 buffer on load, <br>
+     * UTF-8 output is converted back while printing <br>
+     * Big-endian UTF-16 is swapped to native order on load and back while printing <br>
+     * Text of UTF-8 units reads and prints UTF-8 as it is <br>
+     * Big-endian UTF-16 is allowed only for text of UTF-16 units
+     * @param input Encoding of files to load
+     * @param output Encoding to print in
+     */
+    void setEncodings(TextEncoding input, TextEncoding output)
+    {
+        ASSERT(Traits::ENCODING == ENCODING_UTF16 || (input != ENCODING_UTF16BE && output != ENCODING_UTF16BE),
+               "Big-endian UTF-16 is used for text of not UTF-16 units");
+
+        inputEncoding_  = input;
+        outputEncoding_ = output;
+    }
+
+    /*!
+     * @return Pages really obtained for the text buffer
+     */
+    PageBacking getBufferBacking() const { return bufferBacking_; }
+
+    /*!
+     * @return Pages really obtained for the array of lines
+     */
+    PageBacking getLinesBacking() const { return stringsBacking_; }
+
+    ~BasicText()
+    {
+        releaseMemory();
+    }
 };
+
+typedef BasicText<char16_t> Text;      //!< Text in UTF-16
+typedef BasicText<char>     Utf8Text;  //!< Text in UTF-8 sorted without conversion
+typedef BasicText<char32_t> Utf32Text; //!< Text in UTF-32
+
+#endif /* TEXT_H_INCLUDED */
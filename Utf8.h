@@ -0,0 +1,401 @@
+/*!
+ * \file
+ * \brief
+ * \details Fast UTF-8, UTF-16 and UTF-32 transcoding. Runs of ASCII are converted 16 symbols at a time with SSE2
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef UTF8_H_INCLUDED
+#define UTF8_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*!
+ * Symbol put instead of malformed sequences
+ */
+const char16_t UTF16_REPLACEMENT = 0xfffd;
+
+/*!
+ * Encodings of files Text is able to read and write
+ */
+enum TextEncoding
+{
+    ENCODING_UTF16,   //!< UTF-16, byte order mark tells the order on input, native order on output
+    ENCODING_UTF8,    //!< UTF-8
+    ENCODING_UTF32,   //!< UTF-32, any byte order on input, native on output
+    ENCODING_UTF16BE  //!< UTF-16 big-endian unless byte order mark tells other, big-endian on output
+};
+
+/*!
+ * Parses encoding name given by user
+ * @param name "utf8", "utf16", "utf16be" or "utf32", with or without dash
+ * @param encoding Place to write result
+ * @return false if name is unknown
+ */
+bool parseEncoding(const char* name, TextEncoding* encoding)
+{
+    std::string lower(name);
+    for (char& c : lower)
+        c = (char) tolower(c);
+
+    if (lower == "utf8" || lower == "utf-8")
+        *encoding = ENCODING_UTF8;
+    else if (lower == "utf16" || lower == "utf-16")
+        *encoding = ENCODING_UTF16;
+    else if (lower == "utf16be" || lower == "utf-16be")
+        *encoding = ENCODING_UTF16BE;
+    else if (lower == "utf32" || lower == "utf-32")
+        *encoding = ENCODING_UTF32;
+    else
+        return false;
+
+    return true;
+}
+
+/*!
+ * Tells if byte continues multibyte UTF-8 sequence
+ */
+inline bool utf8_is_continuation(unsigned char c)
+{
+    return (c & 0xc0) == 0x80;
+}
+
+/*!
+ * Decodes one symbol of UTF-8 <br>
+ * Malformed sequences and overlong forms become UTF16_REPLACEMENT
+ * @param s Bytes of symbol
+ * @param size Number of bytes available, at least 1
+ * @param length Place to write number of bytes taken
+ * @return Code point
+ */
+inline uint32_t utf8_decode(const unsigned char* s, size_t size, size_t* length)
+{
+    unsigned char c = s[0];
+    *length = 1;
+
+    if (c < 0x80)
+        return c;
+
+    if ((c >> 5) == 0x6 && size > 1 && utf8_is_continuation(s[1]))
+    {
+        uint32_t decoded = ((c & 0x1f) << 6) | (s[1] & 0x3f);
+        if (decoded >= 0x80)
+        {
+            *length = 2;
+            return decoded;
+        }
+    }
+    else if ((c >> 4) == 0xe && size > 2 && utf8_is_continuation(s[1]) && utf8_is_continuation(s[2]))
+    {
+        uint32_t decoded = ((c & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+        if (decoded >= 0x800 && (decoded < 0xd800 || decoded > 0xdfff))
+        {
+            *length = 3;
+            return decoded;
+        }
+    }
+    else if ((c >> 3) == 0x1e && size > 3 && utf8_is_continuation(s[1]) &&
+             utf8_is_continuation(s[2]) && utf8_is_continuation(s[3]))
+    {
+        uint32_t decoded = ((c & 0x07) << 18) | ((s[1] & 0x3f) << 12) |
+                           ((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+        if (decoded >= 0x10000 && decoded <= 0x10ffff)
+        {
+            *length = 4;
+            return decoded;
+        }
+    }
+
+    return UTF16_REPLACEMENT;
+}
+
+/*!
+ * Encodes one code point to UTF-8
+ * @param code Code point, at most 0x10ffff
+ * @param out Place for at least 4 bytes
+ * @return Pointer after the last byte written
+ */
+inline unsigned char* utf8_encode(uint32_t code, unsigned char* out)
+{
+    if (code < 0x80)
+        *out++ = (unsigned char) code;
+    else if (code < 0x800)
+    {
+        *out++ = (unsigned char) (0xc0 | (code >> 6));
+        *out++ = (unsigned char) (0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = (unsigned char) (0xe0 | (code >> 12));
+        *out++ = (unsigned char) (0x80 | ((code >> 6) & 0x3f));
+        *out++ = (unsigned char) (0x80 | (code & 0x3f));
+    }
+    else
+    {
+        *out++ = (unsigned char) (0xf0 | (code >> 18));
+        *out++ = (unsigned char) (0x80 | ((code >> 12) & 0x3f));
+        *out++ = (unsigned char) (0x80 | ((code >> 6) & 0x3f));
+        *out++ = (unsigned char) (0x80 | (code & 0x3f));
+    }
+
+    return out;
+}
+
+/*!
+ * Converts UTF-8 to UTF-16 <br>
+ * Malformed sequences and overlong forms become UTF16_REPLACEMENT
+ * @param src Bytes to convert
+ * @param size Number of bytes
+ * @param dst Place for at least size symbols
+ * @return Number of symbols written
+ */
+size_t utf8_to_utf16(const char* src, size_t size, char16_t* dst)
+{
+    const unsigned char* s = (const unsigned char*) src;
+    char16_t* out = dst;
+    size_t i = 0;
+
+    while (i < size)
+    {
+#ifdef __SSE2__
+        while (i + 16 <= size)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) (s + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break;
+
+            __m128i zero = _mm_setzero_si128();
+            _mm_storeu_si128((__m128i*) out,       _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128((__m128i*) (out + 8), _mm_unpackhi_epi8(bytes, zero));
+            out += 16;
+            i += 16;
+        }
+
+        if (i >= size)
+            break;
+#endif
+
+        size_t length = 1;
+        uint32_t code = utf8_decode(s + i, size - i, &length);
+
+        if (code >= 0x10000)
+        {
+            code -= 0x10000;
+            *out++ = (char16_t) (0xd800 + (code >> 10));
+            *out++ = (char16_t) (0xdc00 + (code & 0x3ff));
+        }
+        else
+            *out++ = (char16_t) code;
+
+        i += length;
+    }
+
+    return out - dst;
+}
+
+/*!
+ * Appends UTF-16 symbols converted to UTF-8 to string <br>
+ * Unpaired surrogates become UTF16_REPLACEMENT
+ * @param src Symbols to convert
+ * @param size Number of symbols
+ * @param dst String to append to
+ */
+void utf16_append_utf8(const char16_t* src, size_t size, std::string* dst)
+{
+    size_t start = dst->size();
+    dst->resize(start + 3 * size);
+    unsigned char* out = (unsigned char*) &(*dst)[start];
+    unsigned char* begin = out;
+    size_t i = 0;
+
+    while (i < size)
+    {
+#ifdef __SSE2__
+        while (i + 8 <= size)
+        {
+            __m128i units = _mm_loadu_si128((const __m128i*) (src + i));
+            __m128i high = _mm_and_si128(units, _mm_set1_epi16((short) 0xff80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xffff)
+                break;
+
+            _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(units, units));
+            out += 8;
+            i += 8;
+        }
+
+        if (i >= size)
+            break;
+#endif
+
+        uint32_t code = src[i++];
+
+        if (code >= 0xd800 && code <= 0xdfff)
+        {
+            if (code <= 0xdbff && i < size && src[i] >= 0xdc00 && src[i] <= 0xdfff)
+                code = 0x10000 + ((code - 0xd800) << 10) + (src[i++] - 0xdc00);
+            else
+                code = UTF16_REPLACEMENT;
+        }
+
+        out = utf8_encode(code, out);
+    }
+
+    dst->resize(start + (out - begin));
+}
+
+/*!
+ * Converts UTF-8 to UTF-32 <br>
+ * Malformed sequences and overlong forms become UTF16_REPLACEMENT
+ * @param src Bytes to convert
+ * @param size Number of bytes
+ * @param dst Place for at least size symbols
+ * @return Number of symbols written
+ */
+size_t utf8_to_utf32(const char* src, size_t size, char32_t* dst)
+{
+    const unsigned char* s = (const unsigned char*) src;
+    char32_t* out = dst;
+    size_t i = 0;
+
+    while (i < size)
+    {
+#ifdef __SSE2__
+        while (i + 16 <= size)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*) (s + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break;
+
+            __m128i zero  = _mm_setzero_si128();
+            __m128i low   = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high  = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128((__m128i*) out,        _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128((__m128i*) (out + 4),  _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128((__m128i*) (out + 8),  _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128((__m128i*) (out + 12), _mm_unpackhi_epi16(high, zero));
+            out += 16;
+            i += 16;
+        }
+
+        if (i >= size)
+            break;
+#endif
+
+        size_t length = 1;
+        *out++ = utf8_decode(s + i, size - i, &length);
+        i += length;
+    }
+
+    return out - dst;
+}
+
+/*!
+ * Appends UTF-32 symbols converted to UTF-8 to string <br>
+ * Surrogates and values above 0x10ffff become UTF16_REPLACEMENT
+ * @param src Symbols to convert
+ * @param size Number of symbols
+ * @param dst String to append to
+ */
+void utf32_append_utf8(const char32_t* src, size_t size, std::string* dst)
+{
+    size_t start = dst->size();
+    dst->resize(start + 4 * size);
+    unsigned char* out = (unsigned char*) &(*dst)[start];
+    unsigned char* begin = out;
+    size_t i = 0;
+
+    while (i < size)
+    {
+#ifdef __SSE2__
+        while (i + 8 <= size)
+        {
+            __m128i low  = _mm_loadu_si128((const __m128i*) (src + i));
+            __m128i high = _mm_loadu_si128((const __m128i*) (src + i + 4));
+            __m128i mask = _mm_set1_epi32((int) 0xffffff80);
+            __m128i bits = _mm_or_si128(_mm_and_si128(low, mask), _mm_and_si128(high, mask));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, _mm_setzero_si128())) != 0xffff)
+                break;
+
+            __m128i units = _mm_packs_epi32(low, high);
+            _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(units, units));
+            out += 8;
+            i += 8;
+        }
+
+        if (i >= size)
+            break;
+#endif
+
+        uint32_t code = src[i++];
+        if (code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff))
+            code = UTF16_REPLACEMENT;
+
+        out = utf8_encode(code, out);
+    }
+
+    dst->resize(start + (out - begin));
+}
+
+/*!
+ * Converts UTF-8 to buffer of given code units
+ * @see utf8_to_utf16
+ */
+size_t convertFromUtf8(const char* src, size_t size, char16_t* dst)
+{
+    return utf8_to_utf16(src, size, dst);
+}
+
+/*!
+ * Converts UTF-8 to buffer of UTF-32 symbols
+ * @see utf8_to_utf32
+ */
+size_t convertFromUtf8(const char* src, size_t size, char32_t* dst)
+{
+    return utf8_to_utf32(src, size, dst);
+}
+
+/*!
+ * UTF-8 to UTF-8 conversion, just copies bytes
+ */
+size_t convertFromUtf8(const char* src, size_t size, char* dst)
+{
+    memcpy(dst, src, size);
+    return size;
+}
+
+/*!
+ * Appends code units converted to UTF-8 to string
+ * @see utf16_append_utf8
+ */
+void appendAsUtf8(const char16_t* src, size_t size, std::string* dst)
+{
+    utf16_append_utf8(src, size, dst);
+}
+
+/*!
+ * Appends UTF-32 symbols converted to UTF-8 to string
+ * @see utf32_append_utf8
+ */
+void appendAsUtf8(const char32_t* src, size_t size, std::string* dst)
+{
+    utf32_append_utf8(src, size, dst);
+}
+
+/*!
+ * Appends UTF-8 bytes to string as they are
+ */
+void appendAsUtf8(const char* src, size_t size, std::string* dst)
+{
+    dst->append(src, size);
+}
+
+#endif /* UTF8_H_INCLUDED */
@@ -0,0 +1,379 @@
+/*!
+ * \file
+ * \brief
+ * \details Vocabulary of a text: words with numbers of occurrences, counted and sorted on several threads
+ * \author Roman Loginov
+ * \version 1.0
+ */
+
+#ifndef WORD_FREQUENCY_H_INCLUDED
+#define WORD_FREQUENCY_H_INCLUDED
+
+#include "Text.h"
+#include <thread>
+
+/*!
+ * Order of words in vocabulary
+ */
+enum WordOrder
+{
+    WORDS_ALPHA,     //!< As lines are sorted
+    WORDS_FREQUENCY, //!< Most frequent first, equally frequent in alphabetical order
+    WORDS_RHYME      //!< By endings, as lines are reverse-sorted
+};
+
+/*!
+ * Sorts range on several threads: parts are sorted separately, then merged pairwise
+ * @param first, last Range to sort
+ * @param comp Strict weak order
+ * @param nThreads Number of threads, parts smaller than a few thousands elements are not split
+ */
+template <typename Iterator, typename Comparator>
+void parallelSort(Iterator first, Iterator last, Comparator comp, size_t nThreads)
+{
+    const size_t MIN_PART = 4096;
+
+    size_t size = last - first;
+    size_t nParts = std::max<size_t>(1, std::min(nThreads, size / MIN_PART));
+
+    std::vector<size_t> bounds(nParts + 1);
+    for (size_t i = 0; i <= nParts; ++i)
+        bounds[i] = i * size / nParts;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < nParts; ++i)
+        workers.emplace_back([=]() { std::sort(first + bounds[i], first + bounds[i + 1], comp); });
+
+    std::sort(first + bounds[0], first + bounds[1], comp);
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (size_t step = 1; step < nParts; step *= 2)
+    {
+        workers.clear();
+        for (size_t i = 0; i + step < nParts; i += 2 * step)
+        {
+            Iterator begin = first + bounds[i], middle = first + bounds[i + step];
+            Iterator end = first + bounds[std::min(i + 2 * step, nParts)];
+            workers.emplace_back([=]() { std::inplace_merge(begin, middle, end, comp); });
+        }
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+}
+
+/*!
+ * \brief Open-addressing hash map from words to numbers of occurrences
+ *
+ * Keys are views into the text buffer, words are never copied. <br>
+ * Slots are probed linearly, table doubles when it is half full
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicWordMap
+{
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of words
+
+    /*!
+     * Slot of table, empty while count is 0
+     */
+    struct Entry
+    {
+        String word;   //!< View of the first occurrence
+        uint64_t hash; //!< Hash of word
+        size_t count;  //!< Number of occurrences
+    };
+
+private:
+    static const size_t MIN_CAPACITY_ = 1024; //!< Slots of the first table, power of 2
+
+    std::vector<Entry> slots_; //!< Table, size is power of 2
+    size_t size_;              //!< Number of filled slots
+
+    static bool isSameWord(const String& lhs, const String& rhs)
+    {
+        return lhs.getSize() == rhs.getSize() &&
+               memcmp(lhs.getPtr(), rhs.getPtr(), lhs.getSize() * sizeof(CharT)) == 0;
+    }
+
+    /*!
+     * Slot holding word or empty slot where it should be placed
+     */
+    Entry& findSlot(const String& word, uint64_t hash)
+    {
+        size_t mask = slots_.size() - 1;
+        for (size_t ind = hash & mask; ; ind = (ind + 1) & mask)
+        {
+            Entry& slot = slots_[ind];
+            if (slot.count == 0 || (slot.hash == hash && isSameWord(slot.word, word)))
+                return slot;
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Entry> old(slots_.empty() ? MIN_CAPACITY_ : 2 * slots_.size(), Entry());
+        old.swap(slots_);
+
+        for (const Entry& entry : old)
+            if (entry.count)
+                findSlot(entry.word, entry.hash) = entry;
+    }
+
+public:
+    BasicWordMap():
+        slots_(),
+        size_(0)
+    {}
+
+    /*!
+     * Adds occurrences of word
+     * @param word View of word
+     * @param count Number of occurrences to add
+     */
+    void add(const String& word, size_t count = 1)
+    {
+        add(word, word.hashContent(), count);
+    }
+
+    /*!
+     * Same as above with hash of word already known
+     */
+    void add(const String& word, uint64_t hash, size_t count)
+    {
+        if (2 * (size_ + 1) > slots_.size())
+            grow();
+
+        Entry& slot = findSlot(word, hash);
+        if (slot.count == 0)
+        {
+            slot.word = word;
+            slot.hash = hash;
+            ++size_;
+        }
+
+        slot.count += count;
+    }
+
+    /*!
+     * Adds all words of another map
+     */
+    void merge(const BasicWordMap& that)
+    {
+        for (const Entry& entry : that.slots_)
+            if (entry.count)
+                add(entry.word, entry.hash, entry.count);
+    }
+
+    /*!
+     * Number of occurrences of word, 0 if there are none
+     */
+    size_t getCount(const String& word) const
+    {
+        if (slots_.empty())
+            return 0;
+
+        return const_cast<BasicWordMap*>(this)->findSlot(word, word.hashContent()).count;
+    }
+
+    size_t size() const { return size_; }
+
+    /*!
+     * Appends filled slots to entries in table order
+     */
+    void collect(std::vector<Entry>* entries) const
+    {
+        for (const Entry& entry : slots_)
+            if (entry.count)
+                entries->push_back(entry);
+    }
+};
+
+/*!
+ * \brief Words of a text with their frequencies
+ *
+ * Words are maximal runs of symbols which are neither service symbols of comparators <br>
+ * nor whitespace. Buffer is split into parts at word borders, every thread counts <br>
+ * its part into own map, maps are merged and the vocabulary is sorted in parallel <br>
+ * Words refer to buffer of text, so text must outlive the counter
+ * @tparam CharT Code unit of text
+ */
+template <typename CharT>
+class BasicWordCounter
+{
+public:
+    typedef BasicIntegratedString<CharT> String; //!< Type of words
+    typedef BasicWordMap<CharT>          Map;    //!< Map words are counted in
+    typedef typename Map::Entry          Entry;  //!< Word with number of occurrences
+
+private:
+    static const size_t MIN_PART_ = 1 << 16; //!< Smaller parts of buffer are not given to separate threads
+
+    std::vector<Entry> words_; //!< Vocabulary in current order
+    size_t nTokens_;           //!< Number of words in text with repetitions
+    size_t nThreads_;          //!< Number of threads for counting and sorting
+
+    static bool isSeparator(CharT sym)
+    {
+        return sym == CharT(0) || sym == CharT('\n') || sym == CharT('\r') || sym == CharT('\t') ||
+               String::isProhibitedSymbol(sym);
+    }
+
+    /*!
+     * Counts words of [begin, end) into map
+     * @return Number of words with repetitions
+     */
+    static size_t countPart(const CharT* begin, const CharT* end, Map* map)
+    {
+        size_t nTokens = 0;
+        const CharT* ptr = begin;
+
+        while (ptr != end)
+        {
+            while (ptr != end && isSeparator(*ptr))
+                ++ptr;
+
+            const CharT* word = ptr;
+            while (ptr != end && !isSeparator(*ptr))
+                ++ptr;
+
+            if (ptr != word)
+            {
+                map->add(String(word, ptr - word));
+                ++nTokens;
+            }
+        }
+
+        return nTokens;
+    }
+
+    BasicWordCounter(const BasicWordCounter& that)                   = delete;
+    const BasicWordCounter& operator =(const BasicWordCounter& that) = delete;
+
+public:
+    /*!
+     * @param nThreads Number of threads, 0 means number of cores
+     */
+    explicit BasicWordCounter(size_t nThreads = 0):
+        words_(),
+        nTokens_(0),
+        nThreads_(nThreads ? nThreads : std::max(1u, std::thread::hardware_concurrency()))
+    {}
+
+    /*!
+     * Counts words of loaded text, words are left in unspecified order
+     * @param text Text to count words of
+     */
+    void count(const BasicText<CharT>& text)
+    {
+        const CharT* begin = text.getBuffer() + text.getNHeader();
+        const CharT* end   = text.getBuffer() + text.getNSymbols();
+
+        size_t nParts = std::max<size_t>(1, std::min<size_t>(nThreads_, (end - begin) / MIN_PART_));
+        std::vector<const CharT*> bounds(nParts + 1, end);
+        bounds[0] = begin;
+
+        // Every part ends at a separator, so no word is cut in two
+        for (size_t i = 1; i < nParts; ++i)
+        {
+            const CharT* bound = std::max(bounds[i - 1], begin + i * (end - begin) / nParts);
+            while (bound != end && !isSeparator(*bound))
+                ++bound;
+            bounds[i] = bound;
+        }
+
+        std::vector<Map> maps(nParts);
+        std::vector<size_t> nTokens(nParts, 0);
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < nParts; ++i)
+            workers.emplace_back([&, i]() { nTokens[i] = countPart(bounds[i], bounds[i + 1], &maps[i]); });
+
+        nTokens[0] = countPart(bounds[0], bounds[1], &maps[0]);
+        for (std::thread& worker : workers)
+            worker.join();
+
+        for (size_t i = 1; i < nParts; ++i)
+            maps[0].merge(maps[i]);
+
+        words_.clear();
+        words_.reserve(maps[0].size());
+        maps[0].collect(&words_);
+
+        nTokens_ = 0;
+        for (size_t part : nTokens)
+            nTokens_ += part;
+    }
+
+    /*!
+     * Sorts vocabulary on several threads
+     * @param order Order of words
+     */
+    void sort(WordOrder order)
+    {
+        switch (order)
+        {
+            case WORDS_FREQUENCY:
+                parallelSort(words_.begin(), words_.end(), [](const Entry& lhs, const Entry& rhs)
+                {
+                    return lhs.count != rhs.count ? lhs.count > rhs.count : lhs.word < rhs.word;
+                }, nThreads_);
+                break;
+
+            case WORDS_RHYME:
+                parallelSort(words_.begin(), words_.end(), [](const Entry& lhs, const Entry& rhs)
+                {
+                    return lhs.word.compareReversed(rhs.word);
+                }, nThreads_);
+                break;
+
+            case WORDS_ALPHA:
+            default:
+                parallelSort(words_.begin(), words_.end(), [](const Entry& lhs, const Entry& rhs)
+                {
+                    return lhs.word < rhs.word;
+                }, nThreads_);
+                break;
+        }
+    }
+
+    size_t size()        const { return words_.size(); }
+    size_t getNTokens()  const { return nTokens_; }
+    size_t getNThreads() const { return nThreads_; }
+
+    /*!
+     * I-th word of vocabulary with number of its occurrences
+     */
+    const Entry& operator [](size_t index) const
+    {
+        ASSERT(index < words_.size(), "Out of vocabulary range");
+        return words_[index];
+    }
+
+    /*!
+     * Prints vocabulary in UTF-8 as lines of number of occurrences and word, as uniq -c
+     * @param output File to print in
+     */
+    void printToFile(FILE* output) const
+    {
+        ASSERT(output, "Invalid output file");
+
+        std::string encoded;
+        char number[24] = "";
+        for (const Entry& entry : words_)
+        {
+            snprintf(number, sizeof(number), "%7zu ", entry.count);
+            encoded += number;
+            appendAsUtf8(entry.word.getPtr(), entry.word.getSize(), &encoded);
+            encoded.push_back('\n');
+        }
+
+        fwrite(encoded.data(), 1, encoded.size(), output);
+    }
+};
+
+typedef BasicWordCounter<char16_t> WordCounter;     //!< Vocabulary of UTF-16 text
+typedef BasicWordCounter<char>     Utf8WordCounter; //!< Vocabulary of UTF-8 text
+
+#endif /* WORD_FREQUENCY_H_INCLUDED */
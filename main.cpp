@@ -1,74 +1,522 @@
 
 #include "Text.h"
+#include "Pipeline.h"
+#include "RhymeIndex.h"
+#include "SortedIndex.h"
+#include "SuffixArray.h"
+#include "WordFrequency.h"
 #include <getopt.h>
 
 struct Options
 {
-    bool needOrig;
-    bool needSort;
-    bool needRev;
+    PrintOptions print;
+
+    bool hugePages;
+    bool needStats;
+    bool pipeline;
+    bool asyncIO;
+    bool utf8Direct;
+    bool countDuplicates;
+    bool words;
+    WordOrder wordOrder;
+
+    TextEncoding inputEncoding;
+    TextEncoding outputEncoding;
 
     const char* inputFilename;
     const char* outputFilename;
+    const char* batchFilename;
+    size_t nJobs;
+
+    const char* rhymeWord;
+    const char* rhymeIndexFilename;
+    size_t rhymeLength;
+
+    const char* indexFilename;
+
+    bool query;
+    bool querySuffix;
+    bool queryExact;
+    bool querySubstring;
+    std::vector<const char*> queryPatterns;
+
+    std::vector<const char*> inputFilenames;
+
+    bool hasConflicts;
 };
 
-void printFiles(Text& text, FILE* output, bool needOrig = true, bool needSort = true, bool needRev = true)
+template <typename CharT>
+void printStats(const BasicText<CharT>& text)
 {
-    assert(text.isOk());
-    assert(output);
-    
-    if (needSort)
+    printf("Lines: %zu\n"
+           "Symbols: %zu\n"
+           "Buffer backed by: %s\n"
+           "Lines backed by: %s\n",
+           text.getNLines(), text.getNSymbols(),
+           pageBackingName(text.getBufferBacking()),
+           pageBackingName(text.getLinesBacking()));
+}
+
+Options getOptions(int argc, char** argv);
+
+template <typename CharT>
+void setupText(BasicText<CharT>& text, const Options& options)
+{
+    text.useHugePages(options.hugePages);
+    text.useAsyncIO(options.asyncIO);
+    text.setEncodings(options.inputEncoding, options.outputEncoding);
+}
+
+template <typename Sorter>
+void setupSorter(Sorter& sorter, const Options& options)
+{
+    sorter.setPrintOptions(options.print);
+    sorter.useHugePages(options.hugePages);
+    sorter.useAsyncIO(options.asyncIO);
+    sorter.setEncodings(options.inputEncoding, options.outputEncoding);
+}
+
+int runBatch(const Options& options)
+{
+    FileList files;
+
+    if (options.batchFilename && !files.addList(options.batchFilename))
     {
-        text.sort();
-        text.printToFile(output);
+        printf("Unable to read list of files %s\n", options.batchFilename);
+        return 1;
+    }
+
+    for (const char* input : options.inputFilenames)
+        files.addFile(input);
+
+    size_t nWritten = 0;
+
+    if (options.pipeline)
+    {
+        if (options.utf8Direct)
+        {
+            Utf8PipelineSorter sorter;
+            setupSorter(sorter, options);
+            nWritten = sorter.run(files);
+        }
+        else if (options.inputEncoding == ENCODING_UTF32)
+        {
+            Utf32PipelineSorter sorter;
+            setupSorter(sorter, options);
+            nWritten = sorter.run(files);
+        }
+        else
+        {
+            PipelineSorter sorter;
+            setupSorter(sorter, options);
+            nWritten = sorter.run(files);
+        }
+
+        printf("Asked versions of %zu of %zu files written by pipeline\n", nWritten, files.size());
+    }
+    else
+    {
+        BatchSorter sorter(options.nJobs);
+        setupSorter(sorter, options);
+        sorter.useUtf8Direct(options.utf8Direct);
+        nWritten = sorter.run(files);
+
+        printf("Asked versions of %zu of %zu files written with %zu workers\n",
+               nWritten, files.size(), sorter.getNWorkers());
+    }
+
+    // Skipped inputs are already reported, exit status tells about them too
+    return nWritten == files.size() ? 0 : 1;
+}
+
+/*!
+ * Converts UTF-8 argument to line of text code units
+ * @param utf8 Argument
+ * @param storage Place for converted units
+ */
+template <typename CharT>
+BasicIntegratedString<CharT> makeLine(const char* utf8, std::vector<CharT>* storage)
+{
+    size_t bytes = strlen(utf8);
+    storage->resize(bytes + 1);
+    size_t size = convertFromUtf8(utf8, bytes, storage->data());
+    return BasicIntegratedString<CharT>(storage->data(), size);
+}
+
+/*!
+ * Prints range of lines to stdout in UTF-8
+ * @param lines Anything with operator [] giving lines
+ * @param range Half-open range of positions
+ */
+template <typename Lines>
+void printLinesUtf8(const Lines& lines, std::pair<size_t, size_t> range)
+{
+    std::string output;
+    for (size_t i = range.first; i < range.second; ++i)
+    {
+        appendAsUtf8(lines[i].getPtr(), lines[i].getSize(), &output);
+        output.push_back('\n');
     }
 
-    if (needRev)
+    fwrite(output.data(), 1, output.size(), stdout);
+}
+
+template <typename CharT>
+void printRhymes(BasicText<CharT>& text, const Options& options)
+{
+    BasicRhymeIndex<CharT> index(options.rhymeLength);
+
+    if (!options.rhymeIndexFilename || !index.load(options.rhymeIndexFilename, options.inputFilename, text))
     {
+        index.build(text);
+
+        if (options.rhymeIndexFilename && !index.save(options.rhymeIndexFilename, options.inputFilename, text))
+            printf("Unable to write rhyme index %s\n", options.rhymeIndexFilename);
+    }
+
+    if (!options.rhymeWord)
+        return;
+
+    std::vector<CharT> word;
+    typename BasicRhymeIndex<CharT>::Range rhymes = index.findRhymes(makeLine(options.rhymeWord, &word));
+    printf("Lines rhyming with %s: %zu\n", options.rhymeWord, rhymes.second - rhymes.first);
+    printLinesUtf8(index, rhymes);
+}
+
+/*!
+ * Subcommand query with --substring: prints lines containing every pattern
+ */
+template <typename CharT>
+int runSubstringQuery(const BasicText<CharT>& text, const Options& options)
+{
+    BasicSuffixArray<CharT> suffixes;
+    suffixes.build(text);
+
+    std::vector<CharT> storage;
+    for (const char* pattern : options.queryPatterns)
+    {
+        BasicIntegratedString<CharT> key = makeLine(pattern, &storage);
+        std::vector<size_t> lines = suffixes.findLines(text, key.getPtr(), key.getSize());
+
+        printf("Lines containing %s: %zu\n", pattern, lines.size());
+        fflush(stdout);
+        for (size_t line : lines)
+            printLinesUtf8(text, std::make_pair(line, line + 1));
+    }
+
+    return 0;
+}
+
+/*!
+ * Subcommand query: sorts text once and looks up every pattern by binary search
+ */
+template <typename CharT>
+int runQuery(const Options& options)
+{
+    BasicText<CharT> text;
+    setupText(text, options);
+    text.loadFromFile(options.inputFilename);
+
+    if (options.querySubstring)
+        return runSubstringQuery(text, options);
+
+    if (options.querySuffix)
         text.sort(reverseStringComparator);
-        text.printToFile(output);
+    else
+        text.sort();
+
+    std::vector<CharT> storage;
+    for (const char* pattern : options.queryPatterns)
+    {
+        BasicIntegratedString<CharT> key = makeLine(pattern, &storage);
+        typename BasicText<CharT>::Range lines = options.queryExact ? text.equalRange(key, options.querySuffix)
+                                                                    : text.prefixRange(key, options.querySuffix);
+
+        printf("Lines %s %s: %zu\n", options.queryExact ? "equal to" : (options.querySuffix ? "ending with" : "starting with"),
+               pattern, lines.second - lines.first);
+        fflush(stdout);
+        printLinesUtf8(text, lines);
+    }
+
+    return 0;
+}
+
+template <typename CharT>
+bool printIndexed(BasicText<CharT>& text, const Options& options)
+{
+    if (!text.readRawFromFile(options.inputFilename))
+    {
+        printf("Unable to read file: %s\n", options.inputFilename);
+        return false;
+    }
+
+    IndexUsage usage = INDEX_FAILED;
+    bool isWritten = false;
+
+    if (options.asyncIO)
+    {
+        OutputBatch batch;
+        usage = produceIndexedVersions(text, options.inputFilename, options.indexFilename, options.print,
+                                       [&batch](const BasicText<CharT>& version, size_t maxLines)
+                                       {
+                                           version.collectOutput(&batch, maxLines);
+                                       });
+        isWritten = batch.write(options.outputFilename, threadIoRing());
+    }
+    else if (FILE* output = fopen(options.outputFilename, "wb"))
+    {
+        usage = produceIndexedVersions(text, options.inputFilename, options.indexFilename, options.print,
+                                       [output](const BasicText<CharT>& version, size_t maxLines)
+                                       {
+                                           version.printToFile(output, maxLines);
+                                       });
+        isWritten = fclose(output) == 0;
     }
 
-    if (needOrig)
+    if (!isWritten)
     {
-        text.recoverOriginal();
-        text.printToFile(output);
+        printf("Unable to write file %s\n", options.outputFilename);
+        return false;
     }
+
+    if (usage == INDEX_REUSED)
+        printf("Sorted orders taken from index %s\n", options.indexFilename);
+    else if (usage == INDEX_FAILED)
+        printf("Unable to write index %s\n", options.indexFilename);
+
+    return true;
 }
 
-Options getOptions(int argc, char** argv);
+/*!
+ * Prints lines in sorted order with numbers of their occurrences, as sort | uniq -c
+ * @param text Text after removeDuplicates
+ * @param counts Occurrences of lines in original order
+ * @param options Sorting options
+ */
+template <typename CharT>
+void printDuplicateCounts(BasicText<CharT>& text, const std::vector<uint32_t>& counts, PrintOptions options)
+{
+    options.top = 0;
+    sortDirection(text, false, options);
 
-int main(int argc, char** argv)
+    std::vector<uint32_t> order(text.getNLines());
+    text.getPermutation(order.data());
+
+    std::string output;
+    char number[16] = "";
+    for (size_t i = 0; i < text.getNLines(); ++i)
+    {
+        snprintf(number, sizeof(number), "%7u ", counts[order[i]]);
+        output += number;
+        appendAsUtf8(text[i].getPtr(), text[i].getSize(), &output);
+        output.push_back('\n');
+    }
+
+    fwrite(output.data(), 1, output.size(), stdout);
+}
+
+/*!
+ * Mode --words: writes vocabulary of input with frequencies instead of sorted lines
+ */
+template <typename CharT>
+int runWords(const Options& options)
 {
-    Options options = getOptions(argc, argv);
+    BasicText<CharT> text;
+    setupText(text, options);
+    text.loadFromFile(options.inputFilename);
+
+    BasicWordCounter<CharT> counter(options.nJobs);
+    counter.count(text);
+    counter.sort(options.wordOrder);
+
     FILE* output = fopen(options.outputFilename, "wb");
-    
     if (!output)
     {
         printf("Unable to open file %s for output\n", options.outputFilename);
-        assert(output);
+        return 1;
     }
 
-    Text text(options.inputFilename);
-    printFiles(text, output, options.needOrig, options.needSort, options.needRev);
-    
+    counter.printToFile(output);
+    fclose(output);
+
+    printf("Words: %zu, different: %zu, written to %s with %zu threads\n",
+           counter.getNTokens(), counter.size(), options.outputFilename, counter.getNThreads());
+    return 0;
+}
+
+template <typename CharT>
+int runSingle(const Options& options)
+{
+    BasicText<CharT> text;
+    setupText(text, options);
+
+    PrintOptions print = options.print;
+    std::vector<uint32_t> counts;
+
+    if (!options.indexFilename)
+    {
+        if (!text.readRawFromFile(options.inputFilename))
+        {
+            printf("Unable to read file: %s\n", options.inputFilename);
+            return 1;
+        }
+        text.splitLines();
+
+        if (options.countDuplicates)
+        {
+            size_t nRemoved = text.removeDuplicates(&counts);
+            printf("Duplicate lines removed: %zu\n", nRemoved);
+            print.unique = false;
+        }
+    }
+
+    if (options.indexFilename)
+    {
+        if (!printIndexed(text, options))
+            return 1;
+    }
+    else if (options.asyncIO)
+    {
+        if (!writeFilesAsync(text, options.outputFilename, print))
+        {
+            printf("Unable to write file %s\n", options.outputFilename);
+            return 1;
+        }
+    }
+    else
+    {
+        FILE* output = fopen(options.outputFilename, "wb");
+
+        if (!output)
+        {
+            printf("Unable to open file %s for output\n", options.outputFilename);
+            assert(output);
+        }
+
+        printFiles(text, output, print);
+        fclose(output);
+    }
+
+    if (options.needStats)
+        printStats(text);
+
     printf("Asked versions written to %s\n", options.outputFilename);
 
-    fclose(output);
+    if (options.countDuplicates)
+        printDuplicateCounts(text, counts, options.print);
+
+    if (options.rhymeWord || options.rhymeIndexFilename)
+        printRhymes(text, options);
+
     return 0;
 }
 
+int main(int argc, char** argv)
+{
+    bool query = argc > 1 && strcmp(argv[1], "query") == 0;
+    Options options = query ? getOptions(argc - 1, argv + 1) : getOptions(argc, argv);
+    options.query = query;
+
+    if (options.hasConflicts)
+        return 1;
+
+    if (options.query)
+    {
+        if (options.utf8Direct)
+            return runQuery<char>(options);
+
+        if (options.inputEncoding == ENCODING_UTF32)
+            return runQuery<char32_t>(options);
+
+        return runQuery<char16_t>(options);
+    }
+
+    if (options.words)
+    {
+        if (options.utf8Direct)
+            return runWords<char>(options);
+
+        if (options.inputEncoding == ENCODING_UTF32)
+            return runWords<char32_t>(options);
+
+        return runWords<char16_t>(options);
+    }
+
+    if (options.batchFilename || options.inputFilenames.size() > 1)
+        return runBatch(options);
+
+    if (options.utf8Direct)
+        return runSingle<char>(options);
+
+    if (options.inputEncoding == ENCODING_UTF32)
+        return runSingle<char32_t>(options);
+
+    return runSingle<char16_t>(options);
+}
+
+/*!
+ * Reads order of words from its name: alpha, freq or rhyme
+ * @return false if name is unknown, order is not changed then
+ */
+bool parseWordOrder(const char* name, WordOrder* order)
+{
+    if (strcmp(name, "alpha") == 0)
+        *order = WORDS_ALPHA;
+    else if (strcmp(name, "freq") == 0)
+        *order = WORDS_FREQUENCY;
+    else if (strcmp(name, "rhyme") == 0)
+        *order = WORDS_RHYME;
+    else
+        return false;
+
+    return true;
+}
+
 Options getOptions(int argc, char** argv)
 {
     opterr = 1;
-    Options options = { false, false, false, "", "output.txt" };
+    Options options = {};
+    options.print.needOrig = options.print.needSort = options.print.needRev = false;
+    options.inputFilename = "";
+    options.outputFilename = "output.txt";
+    options.inputEncoding = options.outputEncoding = ENCODING_UTF16;
+    options.rhymeLength = RhymeIndex::DEFAULT_SUFFIX_LENGTH;
+    bool outputEncodingGiven = false;
     
-    const char* possibleOptions = "i:osr";
-    option longOpt[6] = { {"input", 1, nullptr, 'i'},
+    const char* possibleOptions = "i:osrk:";
+    option longOpt[34] = { {"input", 1, nullptr, 'i'},
                           {"original", 0, nullptr, 'o'},
                           {"sorted", 0, nullptr, 's'},
                           {"rev", 0, nullptr, 'r'},
                           {"output", 1, nullptr, 0},
+                          {"huge-pages", 0, nullptr, 0},
+                          {"stats", 0, nullptr, 0},
+                          {"batch", 1, nullptr, 0},
+                          {"jobs", 1, nullptr, 0},
+                          {"pipeline", 0, nullptr, 0},
+                          {"async-io", 0, nullptr, 0},
+                          {"top", 1, nullptr, 0},
+                          {"input-encoding", 1, nullptr, 0},
+                          {"output-encoding", 1, nullptr, 0},
+                          {"utf8-direct", 0, nullptr, 0},
+                          {"collate", 0, nullptr, 0},
+                          {"fold-case", 0, nullptr, 0},
+                          {"fold-accents", 0, nullptr, 0},
+                          {"rhymes", 1, nullptr, 0},
+                          {"rhyme-length", 1, nullptr, 0},
+                          {"rhyme-index", 1, nullptr, 0},
+                          {"index", 1, nullptr, 0},
+                          {"suffix", 0, nullptr, 0},
+                          {"exact", 0, nullptr, 0},
+                          {"substring", 0, nullptr, 0},
+                          {"unique", 0, nullptr, 0},
+                          {"count", 0, nullptr, 0},
+                          {"stable", 0, nullptr, 0},
+                          {"line-table", 0, nullptr, 0},
+                          {"key-sort", 0, nullptr, 0},
+                          {"words", 1, nullptr, 0},
+                          {"key", 1, nullptr, 'k'},
+                          {"natural", 0, nullptr, 0},
                           {0, 0, 0, 0} };
 
     int opt = 0;
@@ -79,31 +527,143 @@ Options getOptions(int argc, char** argv)
         {
             case 'i':
                 options.inputFilename = optarg;
+                options.inputFilenames.push_back(optarg);
                 break;
 
             case 'o':
-                options.needOrig = true;
+                options.print.needOrig = true;
                 break;
 
             case 's':
-                options.needSort = true;
+                options.print.needSort = true;
                 break;
 
             case 'r':
-                options.needRev = true;
+                options.print.needRev = true;
                 break;
 
+            case 'k':
+            {
+                FieldKey key = {};
+                if (parseFieldKey(optarg, &key))
+                    options.print.fieldKeys.push_back(key);
+                else
+                    printf("Wrong key %s, expected number of field with optional n and r\n", optarg);
+                break;
+            }
+
             case 0:
                 if (longOpt[optionIndex].flag != 0)
                     break;
                 if (strcmp(longOpt[optionIndex].name, "output") == 0)
                     options.outputFilename = optarg;
+                else if (strcmp(longOpt[optionIndex].name, "huge-pages") == 0)
+                    options.hugePages = true;
+                else if (strcmp(longOpt[optionIndex].name, "stats") == 0)
+                    options.needStats = true;
+                else if (strcmp(longOpt[optionIndex].name, "batch") == 0)
+                    options.batchFilename = optarg;
+                else if (strcmp(longOpt[optionIndex].name, "jobs") == 0)
+                    options.nJobs = strtoul(optarg, nullptr, 10);
+                else if (strcmp(longOpt[optionIndex].name, "pipeline") == 0)
+                    options.pipeline = true;
+                else if (strcmp(longOpt[optionIndex].name, "async-io") == 0)
+                    options.asyncIO = true;
+                else if (strcmp(longOpt[optionIndex].name, "top") == 0)
+                    options.print.top = strtoul(optarg, nullptr, 10);
+                else if (strcmp(longOpt[optionIndex].name, "input-encoding") == 0)
+                {
+                    if (!parseEncoding(optarg, &options.inputEncoding))
+                        printf("Unknown encoding %s, UTF-16 is used\n", optarg);
+                }
+                else if (strcmp(longOpt[optionIndex].name, "output-encoding") == 0)
+                {
+                    outputEncodingGiven = true;
+                    if (!parseEncoding(optarg, &options.outputEncoding))
+                        printf("Unknown encoding %s, UTF-16 is used\n", optarg);
+                }
+                else if (strcmp(longOpt[optionIndex].name, "utf8-direct") == 0)
+                    options.utf8Direct = true;
+                else if (strcmp(longOpt[optionIndex].name, "collate") == 0)
+                    options.print.collate = true;
+                else if (strcmp(longOpt[optionIndex].name, "fold-case") == 0)
+                {
+                    options.print.collate = true;
+                    options.print.fold |= FOLD_CASE;
+                }
+                else if (strcmp(longOpt[optionIndex].name, "fold-accents") == 0)
+                {
+                    options.print.collate = true;
+                    options.print.fold |= FOLD_ACCENTS;
+                }
+                else if (strcmp(longOpt[optionIndex].name, "rhymes") == 0)
+                    options.rhymeWord = optarg;
+                else if (strcmp(longOpt[optionIndex].name, "rhyme-length") == 0)
+                    options.rhymeLength = strtoul(optarg, nullptr, 10);
+                else if (strcmp(longOpt[optionIndex].name, "rhyme-index") == 0)
+                    options.rhymeIndexFilename = optarg;
+                else if (strcmp(longOpt[optionIndex].name, "index") == 0)
+                    options.indexFilename = optarg;
+                else if (strcmp(longOpt[optionIndex].name, "suffix") == 0)
+                    options.querySuffix = true;
+                else if (strcmp(longOpt[optionIndex].name, "exact") == 0)
+                    options.queryExact = true;
+                else if (strcmp(longOpt[optionIndex].name, "substring") == 0)
+                    options.querySubstring = true;
+                else if (strcmp(longOpt[optionIndex].name, "unique") == 0)
+                    options.print.unique = true;
+                else if (strcmp(longOpt[optionIndex].name, "count") == 0)
+                    options.print.unique = options.countDuplicates = true;
+                else if (strcmp(longOpt[optionIndex].name, "stable") == 0)
+                    options.print.stable = true;
+                else if (strcmp(longOpt[optionIndex].name, "line-table") == 0)
+                    options.print.lineTable = true;
+                else if (strcmp(longOpt[optionIndex].name, "key-sort") == 0)
+                    options.print.keySort = true;
+                else if (strcmp(longOpt[optionIndex].name, "natural") == 0)
+                    options.print.natural = true;
+                else if (strcmp(longOpt[optionIndex].name, "words") == 0)
+                {
+                    options.words = true;
+                    if (!parseWordOrder(optarg, &options.wordOrder))
+                        printf("Unknown order of words %s, alpha is used\n", optarg);
+                }
                 break;
         }
     }
     
-    if (options.needSort + options.needRev + options.needOrig == 0)
-        options.needSort = options.needRev = options.needOrig = 1;
+    for (int i = optind; i < argc; ++i)
+        options.queryPatterns.push_back(argv[i]);
+
+    if (options.print.needSort + options.print.needRev + options.print.needOrig == 0)
+        options.print.needSort = options.print.needRev = options.print.needOrig = 1;
+
+    // --stable only fixes the starting order, so it goes with any of them
+    int nSortModes = !options.print.fieldKeys.empty() + options.print.natural + options.print.collate +
+                     options.print.lineTable + options.print.keySort;
+    if (nSortModes > 1)
+    {
+        printf("Only one sort mode may be given: -k, --natural, --collate or --fold-*, --line-table, --key-sort\n");
+        options.hasConflicts = true;
+    }
+
+    if (options.countDuplicates && options.indexFilename)
+    {
+        printf("Duplicates are not counted with index, they are only removed\n");
+        options.countDuplicates = false;
+    }
+
+    if (options.utf8Direct)
+        options.inputEncoding = options.outputEncoding = ENCODING_UTF8;
+    else if (!outputEncodingGiven)
+        options.outputEncoding = options.inputEncoding;
+
+    if ((options.inputEncoding == ENCODING_UTF32) != (options.outputEncoding == ENCODING_UTF32) &&
+        options.outputEncoding != ENCODING_UTF8)
+    {
+        printf("UTF-32 can be converted only to UTF-8, input encoding is used for output\n");
+        options.outputEncoding = options.inputEncoding;
+    }
 
     return options;
 }
@@ -1,10 +1,18 @@
 
 #include "RLTest.h"
 #include "Text.h"
+#include "Pipeline.h"
+#include "Collation.h"
+#include "RhymeIndex.h"
+#include "SortedIndex.h"
+#include "SuffixArray.h"
+#include "KeyPointerSort.h"
+#include "WordFrequency.h"
 #include <cstring>
 #include <string>
 #include <fstream>
 #include <algorithm>
+#include <iterator>
 
 class WiderText : public Text
 {
@@ -113,6 +121,1189 @@ DEFINE_TEST(ProtectedUsage)
                  getNonEmptyLinesCount(outputFilename));
 }
 
+DEFINE_TEST(HugePagesBacking)
+    const char* inputFilename = "../TEST.txt";
+    Text usual(inputFilename);
+    Text huge(inputFilename, true);
+
+    ASSERT_TRUE(huge.isOk());
+    ASSERT_TRUE(huge.getBufferBacking() != PAGES_HEAP);
+    ASSERT_TRUE(huge.getLinesBacking() != PAGES_HEAP);
+    ASSERT_TRUE(huge.getBufferBacking() != PAGES_TRANSPARENT_HUGE || getAnonHugeBytes(huge.getBuffer()) > 0);
+    ASSERT_EQUAL(usual.getNLines(), huge.getNLines());
+
+    for (size_t i = 0; i < usual.getNLines(); ++i)
+        ASSERT_EQUAL(usual[i].getSize(), huge[i].getSize());
+}
+
+DEFINE_TEST(BatchSameAsSingle)
+    const char* inputs[] = { "../TEST.txt", "../OneginSample.txt", "../Onegin.txt" };
+    const size_t nInputs = sizeof(inputs) / sizeof(inputs[0]);
+
+    FileList files;
+    for (size_t i = 0; i < nInputs; ++i)
+        files.addFile(inputs[i], ("batch" + std::to_string(i) + ".txt").c_str());
+
+    BatchSorter sorter(2);
+    sorter.run(files);
+
+    for (size_t i = 0; i < nInputs; ++i)
+    {
+        FILE* output = fopen("output.txt", "wb");
+        {
+            Text text(inputs[i]);
+            printFiles(text, output);
+        }
+        fclose(output);
+
+        std::string diff = std::string("diff output.txt ") + files.getOutput(i) + " > res";
+        system(diff.c_str());
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+}
+
+DEFINE_TEST(BatchSkipsUnreadable)
+    FILE* stale = fopen("batch_missing.txt", "wb");
+    fputs("stale", stale);
+    fclose(stale);
+    fclose(fopen("batch_empty_input.txt", "wb"));
+
+    FileList files;
+    files.addFile("../no_such_input.txt", "batch_missing.txt");
+    files.addFile("batch_empty_input.txt", "batch_empty.txt");
+    files.addFile("../TEST.txt", "batch_after_missing.txt");
+
+    for (bool asyncIO : {false, true})
+    {
+        BatchSorter sorter(1);
+        sorter.useAsyncIO(asyncIO);
+        ASSERT_EQUAL(sorter.run(files), 2);
+
+        ASSERT_EQUAL(getFileBytesNumber("batch_missing.txt"), 5);
+        ASSERT_TRUE(access("batch_empty.txt", F_OK) == 0);
+        ASSERT_EQUAL(getFileBytesNumber("batch_empty.txt"), 0);
+
+        FILE* output = fopen("output.txt", "wb");
+        {
+            Text text("../TEST.txt");
+            printFiles(text, output);
+        }
+        fclose(output);
+
+        system("diff output.txt batch_after_missing.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+
+    // UTF-8 input has its own reading path, pipeline has its own stages
+    for (bool pipeline : {false, true})
+        for (TextEncoding encoding : {ENCODING_UTF16, ENCODING_UTF8})
+        {
+            remove("batch_empty.txt");
+            if (pipeline)
+            {
+                PipelineSorter sorter;
+                sorter.setEncodings(encoding, encoding);
+                ASSERT_EQUAL(sorter.run(files), 2);
+            }
+            else
+            {
+                BatchSorter sorter(1);
+                sorter.setEncodings(encoding, encoding);
+                ASSERT_EQUAL(sorter.run(files), 2);
+            }
+
+            ASSERT_EQUAL(getFileBytesNumber("batch_missing.txt"), 5);
+            ASSERT_TRUE(access("batch_empty.txt", F_OK) == 0);
+            ASSERT_EQUAL(getFileBytesNumber("batch_empty.txt"), 0);
+        }
+}
+
+DEFINE_TEST(PipelineSameAsSingle)
+    const char* inputs[] = { "../Onegin.txt", "../TEST.txt", "../OneginSample.txt",
+                             "../TEST.txt", "../Onegin.txt", "../OneginSample.txt" };
+    const size_t nInputs = sizeof(inputs) / sizeof(inputs[0]);
+
+    FileList files;
+    for (size_t i = 0; i < nInputs; ++i)
+        files.addFile(inputs[i], ("pipeline" + std::to_string(i) + ".txt").c_str());
+
+    PipelineSorter sorter;
+    ASSERT_EQUAL(sorter.run(files), nInputs);
+
+    for (size_t i = 0; i < nInputs; ++i)
+    {
+        FILE* output = fopen("output.txt", "wb");
+        {
+            Text text(inputs[i]);
+            printFiles(text, output);
+        }
+        fclose(output);
+
+        std::string diff = std::string("diff output.txt ") + files.getOutput(i) + " > res";
+        system(diff.c_str());
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+}
+
+DEFINE_TEST(AsyncWriteSameAsPrint)
+    const char* inputFilename = "../Onegin.txt";
+
+    FILE* output = fopen("output.txt", "wb");
+    {
+        Text text(inputFilename);
+        printFiles(text, output);
+    }
+    fclose(output);
+
+    IoRing* rings[] = { threadIoRing(), nullptr };
+    for (IoRing* ring : rings)
+    {
+        Text text;
+        text.useAsyncIO();
+        text.loadFromFile(inputFilename);
+        ASSERT_TRUE(text.isOk());
+
+        OutputBatch batch;
+        text.sort();
+        text.collectOutput(&batch);
+        text.sort(reverseStringComparator);
+        text.collectOutput(&batch);
+        text.recoverOriginal();
+        text.collectOutput(&batch);
+        ASSERT_TRUE(batch.write("async.txt", ring));
+
+        system("diff output.txt async.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+}
+
+DEFINE_TEST(RingRecoversAfterFailure)
+    IoRing ring(4);
+    if (!ring.isOk())
+        return true;
+
+    const char* inputFilename = "../Onegin.txt";
+    size_t bytes = getFileBytesNumber(inputFilename);
+    std::vector<char> expected(bytes), buffer(bytes);
+
+    FILE* input = fopen(inputFilename, "rb");
+    ASSERT_EQUAL(fread(expected.data(), 1, bytes, input), bytes);
+    fclose(input);
+
+    unsigned nFree = ring.getNFree();
+    iovec chunk = { buffer.data(), bytes };
+    IoRequest request = { &chunk, 1, 0, bytes };
+    ring.prepare(IORING_OP_READV, -1, request, 0);
+    ASSERT_EQUAL(ring.withdrawPending(), 1);
+    ASSERT_EQUAL(ring.getNFree(), nFree);
+
+    // Submission on closed descriptor fails, nothing may stay in flight after it
+    int fd = open(inputFilename, O_RDONLY);
+    std::vector<IoRequest> requests = { request };
+    close(fd);
+    ASSERT_TRUE(!transferAll(&ring, IORING_OP_READV, fd, requests));
+    ASSERT_EQUAL(ring.getNInFlight(), 0);
+
+    ring.reset();
+    ASSERT_TRUE(ring.isOk());
+    ASSERT_TRUE(readFileChunked(inputFilename, buffer.data(), bytes, &ring));
+    ASSERT_EQUAL(ring.getNInFlight(), 0);
+    ASSERT_TRUE(buffer == expected);
+}
+
+DEFINE_TEST(PartialSortTopLines)
+    const size_t tops[] = { 1, 10, 5000 };
+
+    for (size_t k : tops)
+    {
+        Text sorted("../Onegin.txt");
+        Text partial("../Onegin.txt");
+
+        sorted.sort(reverseStringComparator);
+        partial.partialSort(k, reverseStringComparator);
+
+        for (size_t i = 0; i < k; ++i)
+        {
+            ASSERT_TRUE(!reverseStringComparator(sorted[i], partial[i]));
+            ASSERT_TRUE(!reverseStringComparator(partial[i], sorted[i]));
+        }
+    }
+}
+
+DEFINE_TEST(TopInEveryMode)
+    Text text("../Onegin.txt");
+
+    for (int mode = 0; mode < 6; ++mode)
+    {
+        PrintOptions options;
+        options.stable    = mode == 0;
+        options.lineTable = mode == 1;
+        options.keySort   = mode == 2;
+        options.natural   = mode == 3;
+        options.collate   = mode == 4;
+        if (mode == 5)
+            options.fieldKeys = {{2, false, false}};
+
+        for (bool reversed : {false, true})
+        {
+            sortDirection(text, reversed, options);
+            std::vector<IntegratedString> full(&text[0], &text[0] + text.getNLines());
+
+            for (size_t k : {1, 10, 300})
+            {
+                options.top = k;
+                text.recoverOriginal();
+                sortDirection(text, reversed, options);
+                for (size_t i = 0; i < k; ++i)
+                    ASSERT_TRUE(text[i].getPtr() == full[i].getPtr());
+            }
+
+            options.top = 0;
+        }
+    }
+}
+
+DEFINE_TEST(Utf8RoundTrip)
+    const char* inputFilename = "../Onegin.txt";
+
+    Text utf16(inputFilename);
+    utf16.setEncodings(ENCODING_UTF16, ENCODING_UTF8);
+    FILE* output = fopen("onegin8.txt", "wb");
+    utf16.printToFile(output);
+    fclose(output);
+
+    Text utf8;
+    utf8.setEncodings(ENCODING_UTF8, ENCODING_UTF16);
+    utf8.loadFromFile("onegin8.txt");
+    ASSERT_EQUAL(utf8.getNLines(), utf16.getNLines());
+    ASSERT_EQUAL(utf8.getNSymbols(), utf16.getNSymbols());
+
+    output = fopen("output.txt", "wb");
+    utf8.printToFile(output);
+    fclose(output);
+
+    system("diff ../Onegin.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+
+    const char* mixed = "Ёж, \xf0\x9f\x98\x80 and \xff bad";
+    char16_t converted[32] = {};
+    size_t nConverted = utf8_to_utf16(mixed, strlen(mixed), converted);
+    ASSERT_EQUAL(nConverted, 16);
+    ASSERT_EQUAL(converted[0], u'Ё');
+    ASSERT_EQUAL(converted[4], 0xd83d);
+    ASSERT_EQUAL(converted[11], UTF16_REPLACEMENT);
+
+    std::string back;
+    utf16_append_utf8(converted, 11, &back);
+    ASSERT_TRUE(back == std::string(mixed, 15));
+}
+
+DEFINE_TEST(Utf8DirectComparator)
+    Utf8String putin(u8"Путин");
+    Utf8String obama(u8"Обама");
+    Utf8String latin("Obama");
+    ASSERT_TRUE(obama < putin);
+    ASSERT_TRUE(reverseStringComparator(obama, putin));
+    ASSERT_TRUE(latin < obama);
+
+    Utf8String punctuated(u8"(Пу-тин!)");
+    ASSERT_TRUE(!(punctuated < putin));
+    ASSERT_TRUE(!(putin < punctuated));
+    ASSERT_TRUE(!reverseStringComparator(punctuated, putin));
+    ASSERT_TRUE(!reverseStringComparator(putin, punctuated));
+
+    Utf8String longer(u8"Путинский");
+    ASSERT_TRUE(putin < longer);
+    ASSERT_TRUE(!(longer < putin));
+}
+
+DEFINE_TEST(Utf8DirectSort)
+    Text utf16("../Onegin.txt");
+    utf16.setEncodings(ENCODING_UTF16, ENCODING_UTF8);
+    FILE* output = fopen("onegin8.txt", "wb");
+    utf16.printToFile(output);
+    fclose(output);
+
+    Utf8Text utf8("onegin8.txt");
+    ASSERT_TRUE(utf8.isOk());
+    ASSERT_EQUAL(utf8.getNLines(), utf16.getNLines());
+
+    utf8.sort();
+    for (size_t i = 1; i < utf8.getNLines(); ++i)
+        ASSERT_TRUE(!(utf8[i] < utf8[i - 1]));
+
+    utf8.sort(reverseStringComparator);
+    for (size_t i = 1; i < utf8.getNLines(); ++i)
+        ASSERT_TRUE(!reverseStringComparator(utf8[i], utf8[i - 1]));
+
+    output = fopen("output.txt", "wb");
+    utf8.recoverOriginal();
+    utf8.printToFile(output);
+    fclose(output);
+
+    system("diff onegin8.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+}
+
+DEFINE_TEST(Utf8DirectReverseSameAsUtf16)
+    Utf8String ba(u8"ба"), bya(u8"бя");
+    ASSERT_TRUE(reverseStringComparator(ba, bya));
+    ASSERT_TRUE(!reverseStringComparator(bya, ba));
+    ASSERT_TRUE(ba.getPrefixKey(true) < bya.getPrefixKey(true));
+
+    Text utf16("../Onegin.txt");
+    utf16.setEncodings(ENCODING_UTF16, ENCODING_UTF8);
+    FILE* output = fopen("onegin8.txt", "wb");
+    utf16.printToFile(output);
+    fclose(output);
+
+    Utf8Text utf8("onegin8.txt");
+    ASSERT_TRUE(utf8.isOk());
+
+    // Reverse version only, as --utf8-direct -r and -r print it, in every stable mode
+    for (int mode = 0; mode < 4; ++mode)
+    {
+        PrintOptions options;
+        options.needRev   = true;
+        options.stable    = mode == 0;
+        options.lineTable = mode == 1;
+        options.keySort   = mode == 2;
+        options.natural   = mode == 3;
+
+        output = fopen("reverse16.txt", "wb");
+        printFiles(utf16, output, options);
+        fclose(output);
+
+        output = fopen("reverse8.txt", "wb");
+        printFiles(utf8, output, options);
+        fclose(output);
+
+        system("diff reverse16.txt reverse8.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+}
+
+DEFINE_TEST(NewlineScanners)
+    const char*     utf8  = u8"Мой дядя\nсамых честных\nправил,\n";
+    const char16_t* utf16 = u"Мой дядя\nсамых честных\nправил,\n";
+    const char32_t* utf32 = U"Мой дядя\nсамых честных\nправил,\n";
+
+    ASSERT_EQUAL(unit_count(utf8,  '\n'), 3);
+    ASSERT_EQUAL(unit_count(utf16, u'\n'), 3);
+    ASSERT_EQUAL(unit_count(utf32, U'\n'), 3);
+    ASSERT_EQUAL(unit_strlen(utf32), 31);
+
+    const char32_t* end = utf32 + unit_strlen(utf32);
+    ASSERT_EQUAL(unit_find(utf32, end, U'\n') - utf32, 8);
+    ASSERT_TRUE(unit_find(utf32, end, U'Ё') == end);
+    ASSERT_EQUAL(unit_find(utf16, utf16 + unit_strlen(utf16), u',') - utf16, 29);
+}
+
+DEFINE_TEST(Utf32SameAsUtf8)
+    Text utf16("../Onegin.txt");
+    utf16.setEncodings(ENCODING_UTF16, ENCODING_UTF8);
+    FILE* output = fopen("onegin8.txt", "wb");
+    utf16.printToFile(output);
+    fclose(output);
+
+    Utf8Text utf8("onegin8.txt");
+    Utf32Text utf32;
+    utf32.setEncodings(ENCODING_UTF8, ENCODING_UTF8);
+    utf32.loadFromFile("onegin8.txt");
+    ASSERT_EQUAL(utf32.getNLines(), utf8.getNLines());
+
+    utf8.sort();
+    utf32.sort();
+    for (size_t i = 0; i < utf8.getNLines(); ++i)
+    {
+        std::string line;
+        appendAsUtf8(utf32[i].getPtr(), utf32[i].getSize(), &line);
+        Utf8String converted(line.data(), line.size());
+        ASSERT_TRUE(!(converted < utf8[i]) && !(utf8[i] < converted));
+    }
+
+    utf32.recoverOriginal();
+    output = fopen("output.txt", "wb");
+    utf32.printToFile(output);
+    fclose(output);
+
+    system("diff onegin8.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+}
+
+DEFINE_TEST(ByteOrderDetection)
+    std::ifstream source("../TEST.txt", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+
+    std::string swapped = bytes;
+    for (size_t i = 0; i + 1 < swapped.size(); i += 2)
+        std::swap(swapped[i], swapped[i + 1]);
+
+    FILE* output = fopen("big_endian.txt", "wb");
+    fwrite(swapped.data(), 1, swapped.size(), output);
+    fclose(output);
+
+    output = fopen("no_bom.txt", "wb");
+    fwrite(bytes.data() + 2, 1, bytes.size() - 2, output);
+    fclose(output);
+
+    Text bigEndian("big_endian.txt");
+    output = fopen("output.txt", "wb");
+    bigEndian.printToFile(output);
+    fclose(output);
+
+    system("diff ../TEST.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+
+    Text noBom("no_bom.txt");
+    ASSERT_EQUAL(noBom.getNLines(), bigEndian.getNLines());
+    ASSERT_TRUE(noBom[0].getPtr()[0] == bigEndian[0].getPtr()[0]);
+
+    output = fopen("output.txt", "wb");
+    noBom.printToFile(output);
+    fclose(output);
+
+    system("diff no_bom.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+
+    // Big-endian file without mark is swapped only when asked, and written back big-endian
+    output = fopen("big_endian_no_bom.txt", "wb");
+    fwrite(swapped.data() + 2, 1, swapped.size() - 2, output);
+    fclose(output);
+
+    Text guessed("big_endian_no_bom.txt");
+    ASSERT_TRUE(guessed[0].getPtr()[0] != noBom[0].getPtr()[0]);
+
+    Text explicitOrder;
+    explicitOrder.setEncodings(ENCODING_UTF16BE, ENCODING_UTF16BE);
+    explicitOrder.loadFromFile("big_endian_no_bom.txt");
+    ASSERT_EQUAL(explicitOrder.getNLines(), noBom.getNLines());
+    ASSERT_TRUE(explicitOrder[0].getPtr()[0] == noBom[0].getPtr()[0]);
+
+    output = fopen("output.txt", "wb");
+    explicitOrder.printToFile(output);
+    fclose(output);
+
+    system("diff big_endian_no_bom.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+
+    bigEndian.setEncodings(ENCODING_UTF16, ENCODING_UTF16BE);
+    output = fopen("output.txt", "wb");
+    bigEndian.printToFile(output);
+    fclose(output);
+
+    system("diff big_endian.txt output.txt > res");
+    ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+}
+
+DEFINE_TEST(SurrogatePairsOrder)
+    IntegratedString emoji(u"\U0001F600");
+    IntegratedString replacement(u"\uFFFD");
+    ASSERT_TRUE(emoji.hasSurrogates());
+    ASSERT_TRUE(!replacement.hasSurrogates());
+    ASSERT_EQUAL(emoji.getSize(), 2);
+    ASSERT_TRUE(replacement < emoji);
+    ASSERT_TRUE(!(emoji < replacement));
+    ASSERT_TRUE(reverseStringComparator(replacement, emoji));
+
+    IntegratedString deseret(u"a\U00010401");
+    IntegratedString cjk(u"a\U00020000");
+    ASSERT_TRUE(deseret < cjk);
+    ASSERT_TRUE(reverseStringComparator(deseret, cjk));
+    ASSERT_TRUE(!reverseStringComparator(cjk, deseret));
+
+    IntegratedString punctuated(u"(\U00020000!)");
+    IntegratedString plain(u"\U00020000");
+    ASSERT_TRUE(!(punctuated < plain) && !(plain < punctuated));
+
+    Text text;
+    text.loadFromBuffer(u"\U0001F600\n\uFFFD\nz\n\U00010401");
+    ASSERT_EQUAL(text.getNLines(), 4);
+    text.sort();
+    ASSERT_TRUE(text[0].getPtr()[0] == u'z');
+    ASSERT_TRUE(text[1].getPtr()[0] == u'\uFFFD');
+    ASSERT_TRUE(!text[1].hasSurrogates());
+    ASSERT_TRUE(text[2].hasSurrogates() && text[3].hasSurrogates());
+    ASSERT_TRUE(text[2] < text[3]);
+}
+
+DEFINE_TEST(CollationOrder)
+    Text text;
+    text.loadFromBuffer(u"ёж\nяма\nЕль\nель\nзима\nEcole\n\u00c9cole\necole\n12 стульев\nжук");
+    collate(text, false);
+
+    const char16_t* expected[] = {u"12 стульев", u"ecole", u"Ecole", u"\u00c9cole",
+                                  u"ёж", u"ель", u"Ель", u"жук", u"зима", u"яма"};
+    ASSERT_EQUAL(text.getNLines(), 10);
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(IntegratedString(expected[i]).getSize() == text[i].getSize() &&
+                    memcmp(expected[i], text[i].getPtr(), text[i].getSize() * sizeof(char16_t)) == 0);
+
+    collate(text, true);
+    ASSERT_TRUE(text[0].getPtr()[0] == u'e');
+    ASSERT_TRUE(text[text.getNLines() - 1].getPtr()[0] == u'Е');
+
+    Utf8Text utf8;
+    utf8.loadFromBuffer(u8"ёж\nяма\nЕль\nель\nзима\nEcole\n\u00c9cole\necole\n12 стульев\nжук");
+    collate(utf8, false);
+    for (size_t i = 0; i < text.getNLines(); ++i)
+    {
+        std::string line;
+        appendAsUtf8(expected[i], IntegratedString(expected[i]).getSize(), &line);
+        ASSERT_TRUE(line.size() == utf8[i].getSize() && memcmp(line.data(), utf8[i].getPtr(), line.size()) == 0);
+    }
+}
+
+DEFINE_TEST(FoldedCollation)
+    Text text;
+    text.loadFromBuffer(u"Онегин\nЁжик\nонегин\nежик\nÉcole\necole");
+
+    Collator plain;
+    Collator foldCase(FOLD_CASE);
+    Collator foldAll(FOLD_CASE | FOLD_ACCENTS);
+
+    for (bool reversed : {false, true})
+    {
+        SortKeyArena keys;
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            plain.appendKey(text[i], reversed, &keys);
+        ASSERT_TRUE(keys.compare(0, 2) != 0);
+        ASSERT_TRUE(keys.compare(1, 3) != 0);
+
+        keys.clear();
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            foldCase.appendKey(text[i], reversed, &keys);
+        ASSERT_TRUE(keys.compare(0, 2) == 0);
+        ASSERT_TRUE(keys.compare(1, 3) != 0);
+        ASSERT_TRUE(keys.compare(4, 5) != 0);
+
+        keys.clear();
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            foldAll.appendKey(text[i], reversed, &keys);
+        ASSERT_TRUE(keys.compare(0, 2) == 0);
+        ASSERT_TRUE(keys.compare(1, 3) == 0);
+        ASSERT_TRUE(keys.compare(4, 5) == 0);
+    }
+
+    collate(text, false, SIZE_MAX, FOLD_CASE | FOLD_ACCENTS);
+    ASSERT_TRUE(text[0].getPtr()[1] == u'c' || text[0].getPtr()[1] == u'C');
+    ASSERT_TRUE(text[2].getPtr()[1] == u'ж' && text[3].getPtr()[1] == u'ж');
+    ASSERT_TRUE(text[4].getPtr()[1] == u'н' && text[5].getPtr()[1] == u'н');
+
+    ASSERT_EQUAL(FoldTable::get().fold(u'Ё', FOLD_ACCENTS), u'Е');
+    ASSERT_EQUAL(FoldTable::get().fold(u'Ё', FOLD_CASE), u'ё');
+    ASSERT_EQUAL(FoldTable::get().fold(0x17d, FOLD_CASE | FOLD_ACCENTS), u'z');
+}
+
+DEFINE_TEST(RhymeIndexLookup)
+    Text text("../Onegin.txt");
+    RhymeIndex index(3);
+    index.build(text);
+    ASSERT_EQUAL(index.getNLines(), text.getNLines());
+
+    size_t nLines = 0;
+    for (size_t i = 0; i < index.getNClusters(); ++i)
+    {
+        RhymeIndex::Range cluster = index.getCluster(i);
+        ASSERT_TRUE(cluster.first < cluster.second);
+        nLines += cluster.second - cluster.first;
+    }
+    ASSERT_EQUAL(nLines, index.getNLines());
+
+    IntegratedString word(u"любовь");
+    RhymeIndex::Range rhymes = index.findRhymes(word);
+    ASSERT_TRUE(rhymes.first < rhymes.second);
+
+    size_t nExpected = 0;
+    for (size_t i = 0; i < text.getNLines(); ++i)
+    {
+        IntegratedString line = text[i];
+        size_t end = line.getSize();
+        while (end > 0 && IntegratedString::isProhibitedSymbol(line.getPtr()[end - 1]))
+            --end;
+        nExpected += end >= 3 && memcmp(line.getPtr() + end - 3, u"овь", 3 * sizeof(char16_t)) == 0;
+    }
+    ASSERT_EQUAL(rhymes.second - rhymes.first, nExpected);
+
+    for (size_t i = rhymes.first; i < rhymes.second; ++i)
+        ASSERT_TRUE(index.findRhymes(index[i]) == rhymes);
+
+    ASSERT_TRUE(index.save("rhymes.idx", "../Onegin.txt", text));
+    RhymeIndex loaded(3);
+    ASSERT_TRUE(loaded.load("rhymes.idx", "../Onegin.txt", text));
+    ASSERT_TRUE(loaded.findRhymes(word) == rhymes);
+    ASSERT_EQUAL(loaded.getNClusters(), index.getNClusters());
+
+    RhymeIndex otherLength(2);
+    ASSERT_TRUE(!otherLength.load("rhymes.idx", "../Onegin.txt", text));
+
+    // Input of the same size with one letter changed
+    system("cp ../Onegin.txt rhymes_input.txt");
+    Text copy("rhymes_input.txt");
+    RhymeIndex copyIndex(3);
+    copyIndex.build(copy);
+    ASSERT_TRUE(copyIndex.save("rhymes_copy.idx", "rhymes_input.txt", copy));
+
+    FILE* input = fopen("rhymes_input.txt", "r+b");
+    fseek(input, 2 * (getFileBytesNumber("rhymes_input.txt") / 4), SEEK_SET);
+    fputc('x', input);
+    fputc(0, input);
+    fclose(input);
+
+    Text edited("rhymes_input.txt");
+    RhymeIndex stale(3);
+    ASSERT_EQUAL(edited.getNSymbols(), copy.getNSymbols());
+    ASSERT_TRUE(!stale.load("rhymes_copy.idx", "rhymes_input.txt", edited));
+
+    // Damaged cluster start
+    FILE* damaged = fopen("rhymes.idx", "r+b");
+    uint64_t badCluster = text.getNLines();
+    fseek(damaged, -(long) sizeof(badCluster), SEEK_END);
+    fwrite(&badCluster, sizeof(badCluster), 1, damaged);
+    fclose(damaged);
+    ASSERT_TRUE(!loaded.load("rhymes.idx", "../Onegin.txt", text));
+}
+
+DEFINE_TEST(SortedIndexReuse)
+    remove("sorted.idx");
+
+    Text sample("../Onegin.txt");
+    FILE* output = fopen("printed.txt", "wb");
+    printFiles(sample, output);
+    fclose(output);
+
+    for (IndexUsage expected : {INDEX_WRITTEN, INDEX_REUSED})
+    {
+        Text text;
+        ASSERT_TRUE(text.readRawFromFile("../Onegin.txt"));
+
+        output = fopen("indexed.txt", "wb");
+        IndexUsage usage = produceIndexedVersions(text, "../Onegin.txt", "sorted.idx", PrintOptions(),
+                                                  [output](const Text& version, size_t maxLines)
+                                                  {
+                                                      version.printToFile(output, maxLines);
+                                                  });
+        fclose(output);
+
+        ASSERT_EQUAL(usage, expected);
+        ASSERT_EQUAL(text.getNLines(), sample.getNLines());
+
+        system("diff printed.txt indexed.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+
+    PrintOptions collated;
+    collated.collate = true;
+
+    Text raw;
+    ASSERT_TRUE(raw.readRawFromFile("../Onegin.txt"));
+    InputStamp stamp = InputStamp::make("../Onegin.txt", raw);
+
+    SortedIndex index;
+    ASSERT_TRUE(index.open("sorted.idx"));
+    ASSERT_TRUE(index.matches(stamp, sizeof(char16_t), SortedIndex::getOrderFlags(PrintOptions()), raw.getNSymbols()));
+    ASSERT_TRUE(!index.matches(stamp, sizeof(char16_t), SortedIndex::getOrderFlags(collated), raw.getNSymbols()));
+    ASSERT_TRUE(index.isConsistent(raw.getNSymbols()));
+    size_t nLines = index.getNLines();
+    index.close();
+
+    // Damaged forward order: a line out of range, then every entry the same line
+    std::vector<char> bytes(getFileBytesNumber("sorted.idx"));
+    size_t forward = bytes.size() - 2 * nLines * sizeof(uint32_t);
+    for (size_t nDamaged : {(size_t) 1, nLines})
+    {
+        FILE* file = fopen("sorted.idx", "rb");
+        ASSERT_EQUAL(fread(bytes.data(), 1, bytes.size(), file), bytes.size());
+        fclose(file);
+
+        std::vector<uint32_t> damaged(nDamaged, nDamaged == 1 ? nLines + 99 : 0);
+        memcpy(bytes.data() + forward, damaged.data(), nDamaged * sizeof(uint32_t));
+        file = fopen("sorted.idx", "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+
+        Text text;
+        ASSERT_TRUE(text.readRawFromFile("../Onegin.txt"));
+        output = fopen("indexed.txt", "wb");
+        IndexUsage usage = produceIndexedVersions(text, "../Onegin.txt", "sorted.idx", PrintOptions(),
+                                                  [output](const Text& version, size_t maxLines)
+                                                  {
+                                                      version.printToFile(output, maxLines);
+                                                  });
+        fclose(output);
+
+        ASSERT_EQUAL(usage, INDEX_WRITTEN);
+        system("diff printed.txt indexed.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+}
+
+DEFINE_TEST(LookupRanges)
+    Text text("../Onegin.txt");
+    IntegratedString prefix(u"Мой");
+    IntegratedString suffix(u"овь");
+
+    for (bool reversed : {false, true})
+    {
+        IntegratedString pattern = reversed ? suffix : prefix;
+        size_t nExpected = 0;
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            nExpected += text[i].comparePrefix(pattern, reversed) == 0;
+
+        if (reversed)
+            text.sort(reverseStringComparator);
+        else
+            text.sort();
+
+        Text::Range lines = text.prefixRange(pattern, reversed);
+        ASSERT_TRUE(nExpected > 0);
+        ASSERT_EQUAL(lines.second - lines.first, nExpected);
+
+        for (size_t i = lines.first; i < lines.second; ++i)
+        {
+            Text::Range same = text.equalRange(text[i], reversed);
+            ASSERT_TRUE(same.first <= i && i < same.second);
+            ASSERT_TRUE(lines.first <= same.first && same.second <= lines.second);
+        }
+
+        text.recoverOriginal();
+    }
+
+    text.sort();
+    IntegratedString absent(u"Щщщ");
+    Text::Range none = text.prefixRange(absent);
+    ASSERT_EQUAL(none.first, none.second);
+    ASSERT_EQUAL(none.first, text.lowerBound(absent));
+}
+
+DEFINE_TEST(SuffixArraySearch)
+    Text small;
+    small.loadFromBuffer(u"banana\nanna\n");
+    SuffixArray smallSuffixes;
+    smallSuffixes.build(small, true);
+    ASSERT_EQUAL(smallSuffixes.size(), 12);
+
+    const size_t expected[]    = {11, 6, 10, 5, 3, 1, 7, 0, 9, 4, 2, 8};
+    const size_t expectedLcp[] = { 0, 0,  0, 1, 1, 3, 2, 0, 0, 2, 2, 1};
+    for (size_t i = 0; i < smallSuffixes.size(); ++i)
+    {
+        ASSERT_EQUAL(smallSuffixes[i], expected[i]);
+        ASSERT_EQUAL(smallSuffixes.getLcp(i), expectedLcp[i]);
+    }
+
+    Text text("../Onegin.txt");
+    SuffixArray suffixes;
+    suffixes.build(text);
+
+    std::u16string pattern = u"дядя";
+    SuffixArray::Range found = suffixes.find(pattern.data(), pattern.size());
+
+    size_t nExpected = 0;
+    std::vector<size_t> expectedLines;
+    for (size_t i = 0; i < text.getNLines(); ++i)
+    {
+        std::u16string line(text[i].getPtr(), text[i].getSize());
+        size_t nBefore = nExpected;
+        for (size_t pos = line.find(pattern); pos != std::u16string::npos; pos = line.find(pattern, pos + 1))
+            ++nExpected;
+        if (nExpected > nBefore)
+            expectedLines.push_back(i);
+    }
+
+    ASSERT_TRUE(nExpected > 0);
+    ASSERT_EQUAL(found.second - found.first, nExpected);
+    ASSERT_TRUE(suffixes.findLines(text, pattern.data(), pattern.size()) == expectedLines);
+
+    std::u16string absent = u"\nдядя";
+    found = suffixes.find(absent.data(), absent.size());
+    ASSERT_EQUAL(found.first, found.second);
+}
+
+DEFINE_TEST(DuplicateLines)
+    Text small;
+    small.loadFromBuffer(u"a b\nab\nc\na.b\nc\nd");
+
+    std::vector<uint32_t> counts;
+    ASSERT_EQUAL(small.removeDuplicates(&counts), 3);
+    ASSERT_EQUAL(small.getNLines(), 3);
+    ASSERT_TRUE(counts == std::vector<uint32_t>({3, 2, 1}));
+    ASSERT_TRUE(small[0].isEquivalent(IntegratedString(u"ab")));
+    ASSERT_TRUE(small[1].isEquivalent(IntegratedString(u"c")));
+
+    Text text("../Onegin.txt");
+    size_t nLines = text.getNLines();
+    text.sort();
+
+    size_t nDistinct = 1;
+    for (size_t i = 1; i < nLines; ++i)
+        nDistinct += !text[i].isEquivalent(text[i - 1]);
+
+    ASSERT_EQUAL(text.removeDuplicates(&counts), nLines - nDistinct);
+    ASSERT_EQUAL(text.getNLines(), nDistinct);
+
+    size_t nTotal = 0;
+    for (uint32_t count : counts)
+        nTotal += count;
+    ASSERT_EQUAL(nTotal, nLines);
+
+    for (size_t i = 1; i < text.getNLines(); ++i)
+        ASSERT_TRUE(text[i - 1].getPtr() < text[i].getPtr());
+}
+
+/*!
+ * Forward or backward comparator chosen at run time
+ */
+struct ReverseComparatorIf
+{
+    bool reversed;
+
+    explicit ReverseComparatorIf(bool isReversed): reversed(isReversed) {}
+
+    bool operator ()(const IntegratedString& lhs, const IntegratedString& rhs) const
+    {
+        return reversed ? lhs.compareReversed(rhs) : lhs < rhs;
+    }
+};
+
+DEFINE_TEST(IncrementalAppend)
+    Text full("../Onegin.txt");
+    std::u16string head, tail;
+    for (size_t i = 0; i < full.getNLines(); ++i)
+    {
+        std::u16string& part = (i < full.getNLines() / 3) ? head : tail;
+        if (!part.empty())
+            part.push_back(u'\n');
+        part.append(full[i].getPtr(), full[i].getSize());
+    }
+
+    for (bool reversed : {false, true})
+    {
+        Text text;
+        text.loadFromBuffer(head.data(), head.size());
+        text.sort(ReverseComparatorIf(reversed));
+        text.append(tail.data(), tail.size(), ReverseComparatorIf(reversed));
+        ASSERT_EQUAL(text.getNLines(), full.getNLines());
+
+        full.recoverOriginal();
+        full.sort(ReverseComparatorIf(reversed));
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            ASSERT_TRUE(text[i].isEquivalent(full[i]));
+
+        for (size_t i = 1; i < text.getNLines(); ++i)
+            ASSERT_TRUE(!ReverseComparatorIf(reversed)(text[i], text[i - 1]));
+
+        text.recoverOriginal();
+        full.recoverOriginal();
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) ==
+                        std::u16string(full[i].getPtr(), full[i].getSize()));
+    }
+}
+
+DEFINE_TEST(AdaptiveSortRuns)
+    typedef std::pair<int, int> Item;
+    auto byKey = [](const Item& lhs, const Item& rhs) { return lhs.first < rhs.first; };
+
+    const size_t size = 5000;
+    uint32_t seed = 12345;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (int) (seed >> 8); };
+
+    for (int pattern = 0; pattern < 6; ++pattern)
+    {
+        std::vector<Item> items(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            int key = 0;
+            switch (pattern)
+            {
+                case 0: key = random() % 1000;            break;
+                case 1: key = i;                          break;
+                case 2: key = size - i;                   break;
+                case 3: key = i % 700;                    break;
+                case 4: key = i / 10;                     break;
+                case 5: key = (random() % 50) ? i : -1;   break;
+            }
+            items[i] = Item(key, i);
+        }
+
+        std::vector<Item> expected = items;
+        std::stable_sort(expected.begin(), expected.end(), byKey);
+
+        adaptiveSort(items.begin(), items.end(), byKey);
+        ASSERT_TRUE(items == expected);
+    }
+
+    std::vector<int> sorted(size);
+    for (size_t i = 0; i < size; ++i)
+        sorted[i] = i;
+
+    size_t nComparisons = 0;
+    auto counting = [&nComparisons](int lhs, int rhs) { ++nComparisons; return lhs < rhs; };
+    ASSERT_TRUE(looksPresorted(sorted.begin(), sorted.end(), counting));
+
+    nComparisons = 0;
+    adaptiveSort(sorted.begin(), sorted.end(), counting);
+    ASSERT_TRUE(nComparisons < size);
+
+    std::reverse(sorted.begin(), sorted.end());
+    ASSERT_TRUE(looksPresorted(sorted.begin(), sorted.end(), counting));
+
+    Text text("../Onegin.txt");
+    ASSERT_TRUE(!looksPresorted(&text[0], &text[0] + text.getNLines(), std::less<IntegratedString>()));
+
+    text.sort();
+    std::u16string presorted;
+    for (size_t i = 0; i < text.getNLines(); ++i)
+    {
+        presorted.append(text[i].getPtr(), text[i].getSize());
+        presorted.push_back(u'\n');
+    }
+
+    Text again;
+    again.loadFromBuffer(presorted.data(), presorted.size());
+    ASSERT_TRUE(looksPresorted(&again[0], &again[0] + again.getNLines(), std::less<IntegratedString>()));
+
+    again.sort();
+    for (size_t i = 1; i < again.getNLines(); ++i)
+        ASSERT_TRUE(!(again[i] < again[i - 1]));
+}
+
+DEFINE_TEST(StableSortOrder)
+    Text text("../Onegin.txt");
+
+    for (bool reversed : {false, true})
+    {
+        ReverseComparatorIf comp(reversed);
+
+        text.recoverOriginal();
+        text.stableSort(reversed);
+
+        for (size_t i = 1; i < text.getNLines(); ++i)
+        {
+            ASSERT_TRUE(!comp(text[i], text[i - 1]));
+            if (!comp(text[i - 1], text[i]))
+                ASSERT_TRUE(text[i - 1].getPtr() < text[i].getPtr());
+        }
+
+        PrintOptions options;
+        options.stable = true;
+        std::vector<IntegratedString> first(&text[0], &text[0] + text.getNLines());
+
+        text.sort(comp);
+        sortDirection(text, reversed, options);
+        ASSERT_TRUE(std::equal(first.begin(), first.end(), &text[0], [](const IntegratedString& lhs, const IntegratedString& rhs)
+        {
+            return lhs.getPtr() == rhs.getPtr();
+        }));
+    }
+}
+
+DEFINE_TEST(LineTableSort)
+    Text text("../Onegin.txt");
+    Text expected("../Onegin.txt");
+
+    for (bool reversed : {false, true})
+    {
+        expected.recoverOriginal();
+        expected.stableSort(reversed);
+
+        sortByLineTable(text, reversed);
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            ASSERT_EQUAL(text[i].getPtr() - text.getBuffer(), expected[i].getPtr() - expected.getBuffer());
+
+        LineTable table;
+        text.recoverOriginal();
+        table.build(text, reversed);
+        table.sort(reversed);
+        for (size_t i = 0; i < table.size(); ++i)
+        {
+            ASSERT_EQUAL(table.getOffset(i), (size_t) (expected[i].getPtr() - expected.getBuffer()));
+            ASSERT_EQUAL(table.getLength(i), expected[i].getSize());
+            ASSERT_EQUAL(table.getPrefix(i), expected[i].getPrefixKey(reversed));
+        }
+    }
+
+    Text surrogates;
+    surrogates.loadFromBuffer(u"b\nab\na\U0001F600\na\uFFFD\na\U0001F600x\na");
+    Text surrogatesExpected;
+    surrogatesExpected.loadFromBuffer(u"b\nab\na\U0001F600\na\uFFFD\na\U0001F600x\na");
+    surrogatesExpected.stableSort();
+    for (size_t k : {(size_t) 1, (size_t) 3, SIZE_MAX})
+    {
+        surrogates.recoverOriginal();
+        sortByLineTable(surrogates, false, k);
+        for (size_t i = 0; i < std::min(k, surrogates.getNLines()); ++i)
+            ASSERT_EQUAL(surrogates[i].getPtr() - surrogates.getBuffer(), surrogatesExpected[i].getPtr() - surrogatesExpected.getBuffer());
+    }
+}
+
+DEFINE_TEST(KeyPointerSortOrder)
+    Text text("../Onegin.txt");
+    Text expected("../Onegin.txt");
+
+    for (bool reversed : {false, true})
+    {
+        expected.recoverOriginal();
+        expected.stableSort(reversed);
+
+        sortByKeyPointers(text, reversed);
+        for (size_t i = 0; i < text.getNLines(); ++i)
+            ASSERT_EQUAL(text[i].getPtr() - text.getBuffer(), expected[i].getPtr() - expected.getBuffer());
+
+        KeyPointerSorter sorter;
+        text.recoverOriginal();
+        sorter.sort(text, reversed);
+        sorter.reorder();
+        ASSERT_TRUE(sorter.isReordered());
+
+        FILE* output = fopen("keysort.txt", "wb");
+        sorter.printToFile(output, text);
+        fclose(output);
+
+        output = fopen("sorted.txt", "wb");
+        expected.printToFile(output);
+        fclose(output);
+
+        system("cmp keysort.txt sorted.txt > res");
+        ASSERT_EQUAL(getFileBytesNumber("res"), 0);
+    }
+
+    Text surrogates;
+    surrogates.loadFromBuffer(u"b\nab\na\U0001F600\na\uFFFD\na\U0001F600x\n[a]\na");
+    Text surrogatesExpected;
+    surrogatesExpected.loadFromBuffer(u"b\nab\na\U0001F600\na\uFFFD\na\U0001F600x\n[a]\na");
+    surrogatesExpected.stableSort(true);
+    sortByKeyPointers(surrogates, true);
+    for (size_t i = 0; i < surrogates.getNLines(); ++i)
+        ASSERT_EQUAL(surrogates[i].getPtr() - surrogates.getBuffer(), surrogatesExpected[i].getPtr() - surrogatesExpected.getBuffer());
+}
+
+DEFINE_TEST(WordFrequencyCount)
+    Text small;
+    small.loadFromBuffer(u"мой дядя, самых\nчестных правил: дядя мой\n\t(мой)");
+
+    WordCounter counter(1);
+    counter.count(small);
+    ASSERT_EQUAL(counter.getNTokens(), 8);
+    ASSERT_EQUAL(counter.size(), 5);
+
+    counter.sort(WORDS_FREQUENCY);
+    std::string first;
+    appendAsUtf8(counter[0].word.getPtr(), counter[0].word.getSize(), &first);
+    ASSERT_TRUE(first == "мой");
+    ASSERT_EQUAL(counter[0].count, 3);
+    ASSERT_EQUAL(counter[1].count, 2);
+
+    Text text("../Onegin.txt");
+    WordCounter single(1), parallel(4);
+    single.count(text);
+    parallel.count(text);
+    ASSERT_EQUAL(single.getNTokens(), parallel.getNTokens());
+    ASSERT_EQUAL(single.size(), parallel.size());
+
+    for (WordOrder order : {WORDS_ALPHA, WORDS_FREQUENCY, WORDS_RHYME})
+    {
+        single.sort(order);
+        parallel.sort(order);
+
+        for (size_t i = 0; i < single.size(); ++i)
+        {
+            ASSERT_TRUE(single[i].word.getSize() == parallel[i].word.getSize() &&
+                        std::equal(single[i].word.getPtr(), single[i].word.getPtr() + single[i].word.getSize(),
+                                   parallel[i].word.getPtr()));
+            ASSERT_EQUAL(single[i].count, parallel[i].count);
+        }
+    }
+
+    for (size_t i = 1; i < parallel.size(); ++i)
+        ASSERT_TRUE(!reverseStringComparator(parallel[i].word, parallel[i - 1].word));
+}
+
+DEFINE_TEST(FieldKeySort)
+    FieldKey key = {};
+    ASSERT_TRUE(parseFieldKey("3nr", &key));
+    ASSERT_TRUE(key.field == 3 && key.numeric && key.descending);
+    ASSERT_TRUE(!parseFieldKey("0", &key) && !parseFieldKey("2x", &key));
+
+    const char16_t* lines = u"b 10 x\na 2 y\n  c\t2 z\nd -1.5 w\ne";
+    Text text;
+    text.loadFromBuffer(lines);
+
+    FieldTable table;
+    std::vector<FieldKey> keys = {{2, true, false}, {1, false, true}};
+    table.build(text, keys);
+    ASSERT_TRUE(table.getSpan(2, 0) == std::make_pair((size_t) 4, (size_t) 1));
+    ASSERT_TRUE(table.getSpan(4, 0) == std::make_pair((size_t) 1, (size_t) 0));
+    ASSERT_TRUE(table.compare(1, 0) < 0);
+    ASSERT_TRUE(table.compare(2, 1) < 0);
+    ASSERT_TRUE(table.compare(3, 4) < 0);
+
+    PrintOptions options;
+    options.fieldKeys = keys;
+    sortDirection(text, false, options);
+
+    const char16_t* expected[] = {u"d -1.5 w", u"e", u"  c\t2 z", u"a 2 y", u"b 10 x"};
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) == expected[i]);
+
+    options.fieldKeys = {{1, false, false}};
+    text.sort(reverseStringComparator);
+    sortDirection(text, false, options);
+
+    const char16_t* byFirst[] = {u"a 2 y", u"b 10 x", u"  c\t2 z", u"d -1.5 w", u"e"};
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) == byFirst[i]);
+
+    // Table located by the first sort serves the second one
+    FieldTable shared;
+    sortDirection(text, true, options, &shared);
+    ASSERT_TRUE(shared.isBuilt() && shared.getNLines() == text.getNLines());
+    std::vector<uint32_t> reversedOrder(text.getNLines());
+    text.getPermutation(reversedOrder.data());
+
+    sortDirection(text, false, options, &shared);
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) == byFirst[i]);
+
+    sortByFields(text, options.fieldKeys, true);
+    std::vector<uint32_t> rebuiltOrder(text.getNLines());
+    text.getPermutation(rebuiltOrder.data());
+    ASSERT_TRUE(reversedOrder == rebuiltOrder);
+}
+
+DEFINE_TEST(NaturalOrderSort)
+    const char16_t* lines = u"Глава 10\nГлава 2\nГлава 02а\nглава\nТом 1, глава 3\nТом 1, глава 20\nГлава 1";
+    const char16_t* expected[] = {u"Глава 1", u"Глава 2", u"Глава 02а", u"Глава 10",
+                                  u"Том 1, глава 3", u"Том 1, глава 20", u"глава"};
+
+    Text text;
+    text.loadFromBuffer(lines);
+    sortNatural(text, false);
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) == expected[i]);
+
+    text.sort(reverseStringComparator);
+    text.sortByIndices(NaturalComparator(text, false));
+    for (size_t i = 0; i < text.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(text[i].getPtr(), text[i].getSize()) == expected[i]);
+
+    Text words;
+    words.loadFromBuffer(u"a10\nb9\nc100\nd9");
+    sortNatural(words, true);
+    const char16_t* byEnding[] = {u"b9", u"d9", u"a10", u"c100"};
+    for (size_t i = 0; i < words.getNLines(); ++i)
+        ASSERT_TRUE(std::u16string(words[i].getPtr(), words[i].getSize()) == byEnding[i]);
+
+    Text onegin("../Onegin.txt");
+    NaturalComparator reverseNatural(onegin, true);
+    sortNatural(onegin, true);
+
+    std::vector<uint32_t> order(onegin.getNLines());
+    onegin.getPermutation(order.data());
+    for (size_t i = 1; i < order.size(); ++i)
+        ASSERT_TRUE(!reverseNatural(order[i], order[i - 1]));
+}
+
 int main()
 {
     RUN_TEST(StrlenCorrectness);
@@ -122,4 +1313,35 @@ int main()
     RUN_TEST(CheckSameLenSorted);
     RUN_TEST(BufferReadablePlusAccess);
     RUN_TEST(ProtectedUsage);
+    RUN_TEST(HugePagesBacking);
+    RUN_TEST(BatchSameAsSingle);
+    RUN_TEST(BatchSkipsUnreadable);
+    RUN_TEST(PipelineSameAsSingle);
+    RUN_TEST(AsyncWriteSameAsPrint);
+    RUN_TEST(RingRecoversAfterFailure);
+    RUN_TEST(PartialSortTopLines);
+    RUN_TEST(TopInEveryMode);
+    RUN_TEST(Utf8RoundTrip);
+    RUN_TEST(Utf8DirectComparator);
+    RUN_TEST(Utf8DirectSort);
+    RUN_TEST(Utf8DirectReverseSameAsUtf16);
+    RUN_TEST(NewlineScanners);
+    RUN_TEST(Utf32SameAsUtf8);
+    RUN_TEST(ByteOrderDetection);
+    RUN_TEST(SurrogatePairsOrder);
+    RUN_TEST(CollationOrder);
+    RUN_TEST(FoldedCollation);
+    RUN_TEST(RhymeIndexLookup);
+    RUN_TEST(SortedIndexReuse);
+    RUN_TEST(LookupRanges);
+    RUN_TEST(SuffixArraySearch);
+    RUN_TEST(DuplicateLines);
+    RUN_TEST(IncrementalAppend);
+    RUN_TEST(AdaptiveSortRuns);
+    RUN_TEST(StableSortOrder);
+    RUN_TEST(LineTableSort);
+    RUN_TEST(KeyPointerSortOrder);
+    RUN_TEST(WordFrequencyCount);
+    RUN_TEST(FieldKeySort);
+    RUN_TEST(NaturalOrderSort);
 }